@@ -1,30 +1,150 @@
 #include "blob.h"
 #include <cstdio>
 #include <vector>
+#include <algorithm>
+#include "xxhash.h"
+#include "lauxlib.h"
+#include "lz4.h"
 
 Blob::Blob() {
 	data = NULL;
 	length = 0;
 	position = 0;
 	source = "<null>";
+	refs = 1;
+	cloned = false;
 }
 
+Blob::Blob(const Blob & other) {
+	data = other.data;
+	length = other.length;
+	position = other.position;
+	source = other.source;
+	storage = other.storage;
+	refs = 1;
+	cloned = false;
+}
+
+Blob & Blob::operator=(const Blob & other) {
+	data = other.data;
+	length = other.length;
+	position = other.position;
+	source = other.source;
+	storage = other.storage;
+	return *this;
+}
 
 Blob::~Blob() {
-	if(data != NULL)
-		delete[] data;
+
+}
+
+unsigned char *Blob::allocate(size_t size) {
+	std::shared_ptr<unsigned char> buffer(new unsigned char[size], std::default_delete<unsigned char[]>());
+
+	storage = buffer;
+	data = buffer.get();
+	length = (int) size;
+	position = 0;
+
+	return data;
+}
+
+void Blob::slice(Blob *parent, int offset, int length) {
+	if(parent == NULL || !parent->load() || parent->data == NULL) {
+		storage.reset();
+		data = NULL;
+		this->length = 0;
+		position = 0;
+		return;
+	}
+
+	if(offset < 0) offset = 0;
+	if(offset > parent->length) offset = parent->length;
+	if(length < 0 || length > parent->length - offset) length = parent->length - offset;
+
+	storage = parent->storage;
+	data = parent->data + offset;
+	this->length = length;
+	position = 0;
+}
+
+bool Blob::load() {
+	return data != NULL || length == 0;
+}
+
+int Blob::readAt(int offset, unsigned char *dest, int count) {
+	if(data == NULL || offset < 0 || offset >= length) return 0;
+
+	count = min(count, length - offset);
+	memcpy(dest, data + offset, count);
+	return count;
+}
+
+BlobSlice Blob::sub(int offset, int length) {
+	return BlobSlice(this, offset, length);
+}
+
+int Blob::tostring(lua_State *L) {
+	if(!load())
+		return luaL_error(L, "couldn't read %s", source.c_str());
+
+	lua_pushlstring(L, (const char *) data, data == NULL ? 0 : length);
+	return 1;
+}
+
+// streamed blobs read just the value instead of loading everything
+template<typename T>
+static int pushValueAt(lua_State *L, Blob *blob) {
+	lua_Integer offset = luaL_checkinteger(L, 2);
+	T value;
+	if(offset < 0 || offset > (lua_Integer) blob->length - (lua_Integer) sizeof(T) ||
+		blob->readAt((int) offset, (unsigned char *) &value, sizeof(T)) != sizeof(T)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushnumber(L, (lua_Number) value);
+	return 1;
+}
+
+int Blob::u8(lua_State *L) {
+	return pushValueAt<unsigned char>(L, this);
+}
+
+int Blob::u16(lua_State *L) {
+	return pushValueAt<unsigned short>(L, this);
+}
+
+int Blob::u32(lua_State *L) {
+	return pushValueAt<unsigned int>(L, this);
+}
+
+int Blob::f32(lua_State *L) {
+	return pushValueAt<float>(L, this);
 }
 
 HRESULT Blob::QueryInterface(REFIID riid, void ** ppvObject) {
-	return E_NOTIMPL;
+	if(ppvObject == NULL) return E_POINTER;
+
+	if(riid == IID_IUnknown || riid == IID_ISequentialStream || riid == IID_IStream) {
+		*ppvObject = static_cast<IStream *>(this);
+		AddRef();
+		return S_OK;
+	}
+
+	*ppvObject = NULL;
+	return E_NOINTERFACE;
 }
 
 ULONG Blob::AddRef(void) {
-	return 1;
+	return InterlockedIncrement(&refs);
 }
 
 ULONG Blob::Release(void) {
-	return 0;
+	ULONG count = InterlockedDecrement(&refs);
+	if(count == 0 && cloned)
+		delete this;
+	return count;
 }
 
 HRESULT Blob::Read(void * pv, ULONG cb, ULONG * pcbRead) {
@@ -56,9 +176,10 @@ HRESULT Blob::Seek(LARGE_INTEGER dlibMove, DWORD dwOrigin, ULARGE_INTEGER * plib
 		break;
 	}
 
-	start += (int) dlibMove.QuadPart;
-	if(start >= length) start = length - 1;
-	if(start < 0) start = 0;
+	long long target = start + dlibMove.QuadPart;
+	if(target > length) target = length;
+	if(target < 0) target = 0;
+	start = (int) target;
 
 	position = start;
 
@@ -99,12 +220,16 @@ HRESULT Blob::Stat(STATSTG * pstatstg, DWORD grfStatFlag) {
 }
 
 HRESULT Blob::Clone(IStream ** ppstm) {
-	return E_NOTIMPL;
-}
+	if(ppstm == NULL) return E_POINTER;
 
-BlobFromFile::BlobFromFile(const std::string & filename) {
-	source = "file("+filename+")";
+	Blob *clone = new Blob(*this);
+	clone->cloned = true;
+
+	*ppstm = clone;
+	return S_OK;
+}
 
+void Blob::readFile(const std::string & filename) {
 	FILE *file = fopen(filename.c_str(), "rb");
 	if(file == NULL) return;
 
@@ -112,50 +237,368 @@ BlobFromFile::BlobFromFile(const std::string & filename) {
 	size_t size = ftell(file);
 	fseek(file, 0, SEEK_SET);
 
-	data = new unsigned char[size];
-	length = size;
-
+	allocate(size);
 	fread(data, 1, size, file);
 
 	fclose(file);
 }
 
-ResourceDatFile::ResourceDatFile(const std::string & filename) {
+BlobFromFile::BlobFromFile(const std::string & filename) {
+	source = "file("+filename+")";
+
+	readFile(filename);
+}
+
+BlobFromFileStream::BlobFromFileStream(const std::string & filename) :buffer(64 * 1024) {
+	source = "stream(" + filename + ")";
 	this->filename = filename;
+	bufferStart = 0;
+	bufferLength = 0;
+	filePosition = 0;
+
+	file = fopen(filename.c_str(), "rb");
+	if(file == NULL) return;
+
+	fseek(file, 0, SEEK_END);
+	long long size = _ftelli64(file);
+	fseek(file, 0, SEEK_SET);
+
+	length = size < 0 || size > 0x7fffffff ? 0 : (int) size;
+}
+
+BlobFromFileStream::~BlobFromFileStream() {
+	if(file != NULL)
+		fclose(file);
+}
+
+bool BlobFromFileStream::load() {
+	if(data != NULL || length == 0) return true;
+	if(file == NULL) return false;
+
+	Blob contents;
+	contents.allocate(length);
+	if(readAt(0, contents.data, length) != length) return false;
+
+	storage = contents.storage;
+	data = contents.data;
+	return true;
+}
+
+int BlobFromFileStream::readAt(int offset, unsigned char *dest, int count) {
+	if(data != NULL) return Blob::readAt(offset, dest, count);
+	if(file == NULL || offset < 0 || offset >= length) return 0;
+	count = min(count, length - offset);
+
+	if(offset != filePosition && fseek(file, offset, SEEK_SET) != 0)
+		return 0;
+
+	int result = (int) fread(dest, 1, count, file);
+	filePosition = offset + result;
+	return result;
+}
+
+HRESULT BlobFromFileStream::Read(void * pv, ULONG cb, ULONG * pcbRead) {
+	unsigned char *out = (unsigned char *) pv;
+	int left = file == NULL ? 0 : min((int) min(cb, (ULONG) 0x7fffffff), length - position);
+	int total = 0;
+
+	while(left > 0) {
+		if(position >= bufferStart && position < bufferStart + bufferLength) {
+			int count = min(left, bufferStart + bufferLength - position);
+			memcpy(out + total, buffer.data() + position - bufferStart, count);
+			position += count;
+			total += count;
+			left -= count;
+			continue;
+		}
+
+		// reads larger than the buffer go straight into the caller's memory
+		if(left >= (int) buffer.size()) {
+			int count = readAt(position, out + total, left);
+			if(count <= 0) break;
+			position += count;
+			total += count;
+			left -= count;
+			continue;
+		}
+
+		bufferStart = position;
+		bufferLength = readAt(position, buffer.data(), (int) buffer.size());
+		if(bufferLength <= 0) {
+			bufferLength = 0;
+			break;
+		}
+	}
+
+	if(pcbRead) *pcbRead = total;
+	return S_OK;
+}
+
+HRESULT BlobFromFileStream::Clone(IStream ** ppstm) {
+	if(ppstm == NULL) return E_POINTER;
+
+	BlobFromFileStream *clone = new BlobFromFileStream(filename);
+	clone->position = position;
+	clone->cloned = true;
+
+	*ppstm = clone;
+	return S_OK;
+}
+
+BlobSlice::BlobSlice(Blob *parent, int offset, int length) {
+	source = parent == NULL ? "slice(<null>)" : "slice(" + parent->source + ")";
+
+	slice(parent, offset, length);
+}
+
+MappedFile::MappedFile(const std::string & filename) {
+	mapping = NULL;
+	view = NULL;
+	size = 0;
+
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) return;
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > 0x7fffffff) return;
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mapping == NULL) return;
+
+	view = (unsigned char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if(view != NULL)
+		size = (size_t) fileSize.QuadPart;
+}
+
+MappedFile::~MappedFile() {
+	if(view != NULL)
+		UnmapViewOfFile(view);
+	if(mapping != NULL)
+		CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+
+ResourceDatFile::ResourceDatFile(const std::string & filename, bool mapped) {
+	this->filename = filename;
+	this->mapped = mapped;
+	fileSize = 0;
+	fileTime = 0;
+	tableChecksum = 0;
 
 	reload();
 }
 
-void ResourceDatFile::reload() {
-	index.clear();
+// Reads the offset table and entry headers either from a mapping or through stdio. Through stdio the file
+// is read in large blocks, so headers of the small entries that make up most archives come from one read,
+// in the order the offset table lists them, which is usually their order in the file.
+struct ResourceDatReader {
+	FILE *file;
+	const MappedFile *mapped;
+	size_t size;
+
+	std::vector<unsigned char> block;
+	size_t blockStart;
+	size_t blockLength;
+
+	ResourceDatReader(const std::string & filename, const MappedFile *mapped) :mapped(mapped) {
+		file = NULL;
+		size = 0;
+		blockStart = 0;
+		blockLength = 0;
+
+		if(mapped != NULL) {
+			size = mapped->size;
+			return;
+		}
+
+		file = fopen(filename.c_str(), "rb");
+		if(file == NULL) return;
+
+		fseek(file, 0, SEEK_END);
+		long end = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		size = end < 0 ? 0 : (size_t) end;
+	}
 
-	FILE *file = fopen(filename.c_str(), "rb");
-	if(file == NULL) return;
+	~ResourceDatReader() {
+		if(file != NULL)
+			fclose(file);
+	}
 
-	unsigned int indexSize = 0;
-	fread(&indexSize, sizeof(indexSize), 1, file);
+	bool readTable(std::vector<unsigned int> & offsets) {
+		unsigned int count = 0;
+		if(size < sizeof(count)) return false;
 
-	unsigned int *indexOffsets = new unsigned int[indexSize];
-	fread(indexOffsets, sizeof(indexOffsets[0]), indexSize, file);
+		if(mapped != NULL) {
+			memcpy(&count, mapped->view, sizeof(count));
+			if(count > (size - sizeof(count)) / sizeof(unsigned int)) return false;
 
-	for(unsigned int i = 0; i < indexSize; i++) {
-		unsigned int size, namesize;
+			offsets.resize(count);
+			memcpy(offsets.data(), mapped->view + sizeof(count), count * sizeof(unsigned int));
+			return true;
+		}
 
-		fseek(file, indexOffsets[i], SEEK_SET);
-		fread(&size, sizeof(size), 1, file);
-		fread(&namesize, sizeof(namesize), 1, file);
+		if(!load(0, sizeof(count))) return false;
+		memcpy(&count, block.data(), sizeof(count));
+		if(count > (size - sizeof(count)) / sizeof(unsigned int)) return false;
 
-		std::vector<char> vec;
-		vec.resize(namesize);
-		fread(vec.data(), namesize, 1, file);
-		std::string name(vec.begin(), vec.end());
+		// the table and the headers right after it usually fit in the same block
+		size_t tableSize = sizeof(count) + count * sizeof(unsigned int);
+		if(!load(0, tableSize)) return false;
 
-		index[name] = FileInfo(ftell(file), size);
+		offsets.resize(count);
+		memcpy(offsets.data(), block.data() + sizeof(count), count * sizeof(unsigned int));
+		return true;
 	}
 
-	delete[] indexOffsets;
+	// makes block hold length bytes at offset, reading a block's worth or more from there if it doesn't yet
+	bool load(size_t offset, size_t length) {
+		if(offset >= blockStart && offset - blockStart + length <= blockLength) return true;
+		if(file == NULL || offset > size || length > size - offset) return false;
 
-	fclose(file);
+		block.resize(max(length, (size_t) 256 * 1024));
+		blockStart = offset;
+		blockLength = _fseeki64(file, offset, SEEK_SET) == 0 ? fread(block.data(), 1, block.size(), file) : 0;
+		return length <= blockLength;
+	}
+
+	// name stays valid until the next call; length is the uncompressed size stored ahead of compressed data
+	bool readHeader(unsigned int offset, unsigned int & entrySize, unsigned int & length, bool & compressed, const char *& name, unsigned int & namesize) {
+		if(offset > size || size - offset < 2 * sizeof(unsigned int)) return false;
+
+		if(mapped != NULL) {
+			memcpy(&entrySize, mapped->view + offset, sizeof(entrySize));
+			memcpy(&namesize, mapped->view + offset + sizeof(entrySize), sizeof(namesize));
+			name = (const char *) mapped->view + offset + 2 * sizeof(unsigned int);
+		} else {
+			if(!load(offset, 2 * sizeof(unsigned int))) return false;
+			memcpy(&entrySize, block.data() + offset - blockStart, sizeof(entrySize));
+			memcpy(&namesize, block.data() + offset - blockStart + sizeof(entrySize), sizeof(namesize));
+
+			size_t needed = 2 * sizeof(unsigned int) + namesize;
+			if(entrySize & ResourceDatFile::compressedFlag) needed += sizeof(length);
+			if(namesize > size || !load(offset, needed)) return false;
+
+			name = (const char *) block.data() + offset - blockStart + 2 * sizeof(unsigned int);
+		}
+
+		compressed = (entrySize & ResourceDatFile::compressedFlag) != 0;
+		entrySize &= ~ResourceDatFile::compressedFlag;
+
+		size_t nameOffset = offset + 2 * sizeof(unsigned int);
+		if(namesize > size - nameOffset || entrySize > size - nameOffset - namesize) return false;
+
+		length = entrySize;
+		if(compressed && entrySize >= sizeof(length))
+			memcpy(&length, name + namesize, sizeof(length));
+		return true;
+	}
+};
+
+std::vector<std::string> ResourceDatFile::reload() {
+	std::vector<std::string> changed;
+
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attributes)) {
+		for(const auto & entry : index.entries)
+			changed.push_back(index.name(entry));
+
+		index.clear();
+		mapping.reset();
+		fileSize = fileTime = tableChecksum = 0;
+		return changed;
+	}
+
+	unsigned long long size = ((unsigned long long) attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	unsigned long long time = ((unsigned long long) attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	if(size == fileSize && time == fileTime && !index.empty())
+		return changed;
+
+	std::shared_ptr<MappedFile> newMapping;
+	if(mapped) {
+		newMapping = std::make_shared<MappedFile>(filename);
+		if(!newMapping->isValid()) newMapping.reset();
+	}
+
+	ResourceDatReader reader(filename, newMapping.get());
+	std::vector<unsigned int> offsets;
+	if((mapped && !newMapping) || !reader.readTable(offsets))
+		offsets.clear();
+
+	unsigned long long checksum = XXH64(offsets.data(), offsets.size() * sizeof(unsigned int), 0);
+	bool sameLayout = size == fileSize && checksum == tableChecksum && !index.empty();
+
+	fileSize = size;
+	fileTime = time;
+	tableChecksum = checksum;
+
+	mapping = newMapping;
+
+	// an identical offset table in a file of identical size means nothing moved, but the file was written to,
+	// so any entry may have been rewritten in place; without the old contents there's no telling which one
+	if(sameLayout) {
+		for(const auto & entry : index.entries)
+			changed.push_back(index.name(entry));
+		return changed;
+	}
+
+	std::vector<unsigned char> seen(index.size(), 0);
+	index.reserve(offsets.size(), offsets.size() * 40);
+
+	for(unsigned int i = 0; i < offsets.size(); i++) {
+		unsigned int entrySize, length, namesize;
+		bool compressed;
+		const char *name;
+		if(!reader.readHeader(offsets[i], entrySize, length, compressed, name, namesize)) continue;
+
+		size_t offset = offsets[i] + 2 * sizeof(unsigned int) + namesize;
+
+		const auto *entry = index.findEntry(name, namesize);
+		if(entry != NULL) {
+			size_t position = entry - index.entries.data();
+			FileInfo & info = index.entries[position].value;
+
+			// names that only differ in case are one key; the first in the table wins, as it does on every reload
+			if(seen[position]) continue;
+
+			seen[position] = 1;
+			info.slot = i;
+
+			if(info.offset == offset && info.size == entrySize && info.compressed == compressed) {
+				info.length = length;
+				continue;
+			}
+		}
+
+		index.insert(name, namesize, FileInfo(offset, entrySize, length, i, compressed));
+		if(entry == NULL) seen.push_back(1);
+
+		changed.emplace_back(name, namesize);
+	}
+
+	std::vector<std::string> removed;
+	for(size_t i = 0; i < seen.size(); i++) {
+		if(!seen[i]) removed.push_back(index.name(index.entries[i]));
+	}
+	for(const std::string & name : removed) {
+		index.remove(name);
+		changed.push_back(name);
+	}
+
+	return changed;
+}
+
+int ResourceDatFile::reload(lua_State *L) {
+	std::vector<std::string> changed = reload();
+
+	lua_createtable(L, (int) changed.size(), 0);
+	for(size_t i = 0; i < changed.size(); i++) {
+		lua_pushlstring(L, changed[i].data(), changed[i].size());
+		lua_rawseti(L, -2, (int) i + 1);
+	}
+
+	return 1;
 }
 
 BlobFromResourceDat::BlobFromResourceDat(const ResourceDatFile *dat, const std::string & filename){
@@ -165,19 +608,349 @@ BlobFromResourceDat::BlobFromResourceDat(const ResourceDatFile *dat, const std::
 	}
 	source = "resource(" + dat->filename + "," + filename + ")";
 
-	auto iter = dat->index.find(filename);
-	if(iter == dat->index.end()) {
+	const ResourceDatFile::FileInfo *found = dat->index.find(filename);
+	if(found == NULL) {
+		return;
+	}
+	dat->read(this, *found);
+}
+
+int ResourceDatFile::list(lua_State *L) {
+	size_t length = 0;
+	const char *prefix = luaL_optlstring(L, 2, "", &length);
+
+	lua_newtable(L);
+
+	int count = 0;
+	index.forEachWithPrefix(std::string(prefix, length), [&](const PathIndex<FileInfo>::Entry & entry) {
+		lua_createtable(L, 0, 2);
+		lua_pushlstring(L, index.pool.data() + entry.nameOffset, entry.nameLength);
+		lua_setfield(L, -2, "name");
+		lua_pushnumber(L, (lua_Number) entry.value.length);
+		lua_setfield(L, -2, "size");
+		lua_rawseti(L, -2, ++count);
+	});
+
+	return 1;
+}
+
+void ResourceDatFile::read(Blob *blob, const FileInfo & info) const {
+	if(info.compressed) {
+		readCompressed(blob, info);
+		return;
+	}
+
+	if(mapping) {
+		blob->storage = mapping;
+		blob->data = mapping->view + info.offset;
+		blob->length = info.size;
 		return;
 	}
-	const ResourceDatFile::FileInfo &info = iter->second;
 	
-	FILE *file = fopen(dat->filename.c_str(), "rb");
+	FILE *file = fopen(filename.c_str(), "rb");
 	if(file == NULL) return;
 	fseek(file, info.offset, SEEK_SET);
 
-	data = new unsigned char[info.size];
-	length = info.size;
-	fread(data, 1, info.size, file);
+	blob->allocate(info.size);
+	fread(blob->data, 1, info.size, file);
 
 	fclose(file);
-}
\ No newline at end of file
+}
+
+void ResourceDatFile::readCompressed(Blob *blob, const FileInfo & info) const {
+	unsigned int rawSize;
+	if(info.size < sizeof(rawSize)) return;
+
+	// a mapped entry is decompressed straight out of the mapping, otherwise only the compressed bytes are read
+	std::vector<unsigned char> buffer;
+	const unsigned char *stored;
+	if(mapping) {
+		stored = mapping->view + info.offset;
+	} else {
+		FILE *file = fopen(filename.c_str(), "rb");
+		if(file == NULL) return;
+
+		buffer.resize(info.size);
+		fseek(file, info.offset, SEEK_SET);
+		size_t count = fread(buffer.data(), 1, info.size, file);
+		fclose(file);
+
+		if(count != info.size) return;
+		stored = buffer.data();
+	}
+
+	memcpy(&rawSize, stored, sizeof(rawSize));
+	if(rawSize > 0x7fffffff) return;
+
+	blob->allocate(rawSize);
+
+	if(lz4Decompress(stored + sizeof(rawSize), (int) (info.size - sizeof(rawSize)), blob->data, rawSize) != (int) rawSize) {
+		blob->storage.reset();
+		blob->data = NULL;
+		blob->length = 0;
+	}
+}
+
+MappedResourceDatFile::MappedResourceDatFile(const std::string & filename) :ResourceDatFile(filename, true) {
+
+}
+
+ResourceDatWriter::ResourceDatWriter(ResourceDatFile *dat) {
+	this->dat = dat;
+	compress = false;
+}
+
+// stores raw size followed by an LZ4 block, returns false if that is no smaller than the data itself
+static bool compressEntry(const Blob *blob, std::vector<unsigned char> & data) {
+	unsigned int rawSize = blob->length;
+
+	data.resize(sizeof(rawSize) + lz4CompressBound(blob->length));
+	memcpy(data.data(), &rawSize, sizeof(rawSize));
+
+	int size = lz4Compress(blob->data, blob->length, data.data() + sizeof(rawSize), (int) data.size() - sizeof(rawSize));
+	if(size <= 0 || sizeof(rawSize) + size >= rawSize) return false;
+
+	data.resize(sizeof(rawSize) + size);
+	return true;
+}
+
+static bool samePath(const std::string & a, const std::string & b) {
+	if(a.size() != b.size()) return false;
+
+	for(size_t i = 0; i < a.size(); i++) {
+		if(PathIndex<int>::normalize(a[i]) != PathIndex<int>::normalize(b[i]))
+			return false;
+	}
+	return true;
+}
+
+void ResourceDatWriter::put(const std::string & name, Blob *blob) {
+	if(blob == NULL || !blob->load() || blob->data == NULL) return;
+
+	// a replacement keeps the name the archive has, which may be spelled differently, as the game looks that one up
+	std::string stored = name;
+	if(dat != NULL) {
+		const auto *existing = dat->index.findEntry(name.data(), name.size());
+		if(existing != NULL)
+			stored = dat->index.name(*existing);
+	}
+
+	Pending *entry = NULL;
+	for(Pending & existing : pending) {
+		if(samePath(existing.name, stored))
+			entry = &existing;
+	}
+	if(entry == NULL) {
+		pending.emplace_back();
+		entry = &pending.back();
+		entry->name = stored;
+	}
+
+	entry->compressed = compress && compressEntry(blob, entry->data);
+	if(!entry->compressed)
+		entry->data.assign(blob->data, blob->data + blob->length);
+}
+
+static bool writeDatEntry(FILE *file, const std::string & name, const unsigned char *data, unsigned int size, bool compressed) {
+	unsigned int namesize = (unsigned int) name.size();
+	unsigned int sizeField = compressed ? size | ResourceDatFile::compressedFlag : size;
+
+	return fwrite(&sizeField, sizeof(sizeField), 1, file) == 1 &&
+		fwrite(&namesize, sizeof(namesize), 1, file) == 1 &&
+		fwrite(name.data(), 1, namesize, file) == namesize &&
+		fwrite(data, 1, size, file) == size;
+}
+
+int ResourceDatWriter::commit() {
+	error.clear();
+	if(dat == NULL) {
+		error = "no archive";
+		return -1;
+	}
+	if(pending.empty()) return 0;
+
+	dat->reload();
+
+	for(const Pending & entry : pending) {
+		if(dat->index.find(entry.name) == NULL)
+			return compact();
+	}
+
+	FILE *file = fopen(dat->filename.c_str(), "r+b");
+	if(file == NULL) {
+		error = "can't open " + dat->filename + " for writing";
+		return -1;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long long end = _ftelli64(file);
+
+	std::vector<std::pair<unsigned int, unsigned int>> slots;
+	long long written = 0;
+
+	// data goes in before any slot points at it, so an interrupted commit leaves the archive consistent
+	for(const Pending & entry : pending) {
+		unsigned long long size = 2 * sizeof(unsigned int) + entry.name.size() + entry.data.size();
+		if(end + written + size > 0xffffffffull || !writeDatEntry(file, entry.name, entry.data.data(), (unsigned int) entry.data.size(), entry.compressed)) {
+			error = end + written + size > 0xffffffffull ? dat->filename + " would grow past 4GB" : "can't write to " + dat->filename;
+			fclose(file);
+			return -1;
+		}
+
+		slots.emplace_back(dat->index.find(entry.name)->slot, (unsigned int) (end + written));
+		written += size;
+	}
+	bool ok = fflush(file) == 0;
+
+	for(size_t i = 0; ok && i < slots.size(); i++) {
+		ok = fseek(file, sizeof(unsigned int) * (1 + slots[i].first), SEEK_SET) == 0 &&
+			fwrite(&slots[i].second, sizeof(slots[i].second), 1, file) == 1;
+		written += sizeof(slots[i].second);
+	}
+
+	if(fclose(file) != 0) ok = false;
+	if(!ok) {
+		// slots that did get written point at complete entries, so the index is reloaded to match the file
+		error = "can't write to " + dat->filename;
+		dat->reload();
+		return -1;
+	}
+
+	pending.clear();
+	dat->reload();
+
+	return (int) written;
+}
+
+int ResourceDatWriter::compact() {
+	error.clear();
+	if(dat == NULL) {
+		error = "no archive";
+		return -1;
+	}
+
+	dat->reload();
+
+	// blobs from a mapped archive are views into the mapping and keep the file open, so it couldn't be replaced
+	if(dat->mapping && dat->mapping.use_count() > 1) {
+		error = "blobs read from " + dat->filename + " are still alive and keep it mapped; drop them and call collectgarbage() first";
+		return -1;
+	}
+
+	struct Item {
+		std::string name;
+		const ResourceDatFile::FileInfo *info;
+		const Pending *replacement;
+	};
+
+	std::vector<Item> items;
+	for(const auto & entry : dat->index.entries)
+		items.push_back({ dat->index.name(entry), &entry.value, NULL });
+
+	std::sort(items.begin(), items.end(), [](const Item & a, const Item & b) {
+		return a.info->slot < b.info->slot;
+	});
+
+	for(const Pending & entry : pending) {
+		const ResourceDatFile::FileInfo *info = dat->index.find(entry.name);
+
+		auto existing = std::find_if(items.begin(), items.end(), [&](const Item & item) {
+			return item.info == info;
+		});
+
+		if(info != NULL && existing != items.end())
+			existing->replacement = &entry;
+		else
+			items.push_back({ entry.name, NULL, &entry });
+	}
+
+	FILE *source = NULL;
+	if(!dat->mapping) {
+		source = fopen(dat->filename.c_str(), "rb");
+		if(source == NULL && !dat->index.empty()) {
+			error = "can't open " + dat->filename;
+			return -1;
+		}
+	}
+
+	std::string tempname = dat->filename + ".tmp";
+	FILE *file = fopen(tempname.c_str(), "wb");
+	if(file == NULL) {
+		error = "can't create " + tempname;
+		if(source != NULL) fclose(source);
+		return -1;
+	}
+
+	std::vector<unsigned int> offsets(items.size());
+	unsigned int count = (unsigned int) items.size();
+	unsigned long long position = sizeof(count) + count * sizeof(unsigned int);
+
+	for(size_t i = 0; i < items.size(); i++) {
+		size_t size = items[i].replacement != NULL ? items[i].replacement->data.size() : items[i].info->size;
+		offsets[i] = (unsigned int) position;
+		position += 2 * sizeof(unsigned int) + items[i].name.size() + size;
+	}
+
+	bool ok = position <= 0xffffffffull &&
+		fwrite(&count, sizeof(count), 1, file) == 1 &&
+		fwrite(offsets.data(), sizeof(unsigned int), count, file) == count;
+
+	std::vector<unsigned char> buffer;
+	for(size_t i = 0; ok && i < items.size(); i++) {
+		const Item & item = items[i];
+
+		if(item.replacement != NULL) {
+			ok = writeDatEntry(file, item.name, item.replacement->data.data(), (unsigned int) item.replacement->data.size(), item.replacement->compressed);
+		} else if(dat->mapping) {
+			ok = writeDatEntry(file, item.name, dat->mapping->view + item.info->offset, (unsigned int) item.info->size, item.info->compressed);
+		} else {
+			buffer.resize(item.info->size);
+			ok = fseek(source, (long) item.info->offset, SEEK_SET) == 0 &&
+				fread(buffer.data(), 1, buffer.size(), source) == buffer.size() &&
+				writeDatEntry(file, item.name, buffer.data(), (unsigned int) buffer.size(), item.info->compressed);
+		}
+	}
+
+	if(source != NULL) fclose(source);
+	if(fclose(file) != 0) ok = false;
+
+	// our own mapping would keep the file from being replaced; reload() below maps it again
+	dat->mapping.reset();
+	dat->fileSize = 0;
+
+	if(!ok) {
+		error = position > 0xffffffffull ? dat->filename + " would grow past 4GB" : "can't write " + tempname;
+	} else if(!MoveFileExA(tempname.c_str(), dat->filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		error = "can't replace " + dat->filename + ", it is open or mapped elsewhere (error " + std::to_string(GetLastError()) + ")";
+		ok = false;
+	}
+
+	if(!ok) {
+		DeleteFileA(tempname.c_str());
+		dat->reload();
+		return -1;
+	}
+
+	pending.clear();
+	dat->reload();
+
+	return (int) position;
+}
+
+int ResourceDatWriter::commit(lua_State *L) {
+	int written = commit();
+	if(written < 0)
+		return luaL_error(L, "resourceDatWriter:commit(): %s", error.c_str());
+
+	lua_pushinteger(L, written);
+	return 1;
+}
+
+int ResourceDatWriter::compact(lua_State *L) {
+	int size = compact();
+	if(size < 0)
+		return luaL_error(L, "resourceDatWriter:compact(): %s", error.c_str());
+
+	lua_pushinteger(L, size);
+	return 1;
+}
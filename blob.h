@@ -4,15 +4,62 @@
 #include <windows.h>
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
+#include "path-index.h"
+#include "lua.h"
 
+struct MappedFile {
+	HANDLE file;
+	HANDLE mapping;
+	unsigned char *view;
+	size_t size;
+
+	MappedFile(const std::string & filename);
+	~MappedFile();
+
+	bool isValid() const {
+		return view != NULL;
+	}
+};
+
+struct BlobSlice;
+
+// Blobs don't own their bytes directly: data points into storage, which is a heap buffer, a mapped file,
+// or the storage of another blob this one is a slice of. Copies and slices share storage instead of copying bytes.
 struct Blob :public IStream {
 	unsigned char *data;
 	int length;
 
 	std::string source;
 
+	std::shared_ptr<void> storage;
+
 	Blob();
-	~Blob();
+	Blob(const Blob & other);
+	Blob & operator=(const Blob & other);
+	virtual ~Blob();
+
+	/// Replaces data with a new owned buffer of the given size and returns it.
+	unsigned char *allocate(size_t size);
+
+	/// Makes this blob a view of part of another blob's data. The range is clamped to the parent's length.
+	void slice(Blob *parent, int offset, int length);
+
+	/// Makes sure data holds the blob's bytes, reading them into memory if they are streamed from a file.
+	/// Returns false if they couldn't be read.
+	virtual bool load();
+
+	/// Copies up to count bytes starting at offset, returns how many there were.
+	virtual int readAt(int offset, unsigned char *dest, int count);
+
+	// Lua accessors. Offsets start at 0; typed reads are little-endian and return nil past the end.
+	BlobSlice sub(int offset, int length);
+	int tostring(lua_State *L);
+	int u8(lua_State *L);
+	int u16(lua_State *L);
+	int u32(lua_State *L);
+	int f32(lua_State *L);
 
 	int position;
 
@@ -34,37 +81,144 @@ struct Blob :public IStream {
 	HRESULT STDMETHODCALLTYPE UnlockRegion(ULARGE_INTEGER libOffset,ULARGE_INTEGER cb,DWORD dwLockType);
 	HRESULT STDMETHODCALLTYPE Stat(__RPC__out STATSTG *pstatstg,DWORD grfStatFlag);
 	HRESULT STDMETHODCALLTYPE Clone(__RPC__deref_out_opt IStream **ppstm);
+
+	void readFile(const std::string & filename);
+
+protected:
+	// references held through IUnknown. Blobs made by Clone() live on the heap and delete themselves when
+	// this drops to zero; other blobs belong to whoever constructed them (usually Lua) and never do.
+	LONG refs;
+	bool cloned;
 };
 
 struct BlobFromFile :public Blob {
 	BlobFromFile(const std::string & filename);
 };
 
+// Reads a file through a small read-ahead buffer instead of loading it whole. data stays NULL for consumers
+// that go through IStream or readAt(), such as Surface(Blob*); the others call load(), which reads all of it.
+struct BlobFromFileStream :public Blob {
+	std::string filename;
+	FILE *file;
+
+	std::vector<unsigned char> buffer;
+	int bufferStart;
+	int bufferLength;
+	int filePosition;
+
+	BlobFromFileStream(const std::string & filename);
+	BlobFromFileStream(const BlobFromFileStream &) = delete;
+	~BlobFromFileStream();
+
+	HRESULT STDMETHODCALLTYPE Read(_Out_writes_bytes_to_(cb, *pcbRead)  void *pv,_In_  ULONG cb,_Out_opt_  ULONG *pcbRead);
+	HRESULT STDMETHODCALLTYPE Clone(__RPC__deref_out_opt IStream **ppstm);
+
+	bool load();
+	int readAt(int offset, unsigned char *dest, int count);
+};
+
+struct BlobSlice :public Blob {
+	BlobSlice(Blob *parent, int offset, int length);
+};
+
 struct ResourceDatFile {
+	// set in an entry's size field when its data is a 32 bit uncompressed size followed by an LZ4 block
+	static const unsigned int compressedFlag = 0x80000000u;
+
 	struct FileInfo {
 		size_t offset;
-		size_t size;
+		size_t size; // size of the data as stored in the archive
+		size_t length; // size of the contents, which is larger than size for compressed entries
+		unsigned int slot; // position in the archive's offset table
+		bool compressed;
 
 		FileInfo() {
 			offset = 0;
 			size = 0;
+			length = 0;
+			slot = 0;
+			compressed = false;
 		}
-		FileInfo(size_t o, size_t s) {
+		FileInfo(size_t o, size_t s, size_t l, unsigned int sl, bool c) {
 			offset = o;
 			size = s;
+			length = l;
+			slot = sl;
+			compressed = c;
 		}
 	};
 
 	std::string filename;
-	std::map<std::string, FileInfo> index;
+	PathIndex<FileInfo> index;
+
+	bool mapped;
+	std::shared_ptr<MappedFile> mapping;
+
+	// what the index was built from, used to skip work when the archive has not changed
+	unsigned long long fileSize;
+	unsigned long long fileTime;
+	unsigned long long tableChecksum;
 
-	ResourceDatFile(const std::string & filename);
+	ResourceDatFile(const std::string & filename, bool mapped = false);
+
+	/// Brings the index up to date with the file and returns names of entries that were added, changed or removed.
+	/// Entries whose offset, size and name are unchanged are left alone, unless the file was modified without
+	/// its offset table changing, in which case every entry is reported.
+	std::vector<std::string> reload();
+	int reload(lua_State *L);
+
+	/// Returns a sorted table of { name = ..., size = ... } for entries whose name starts with the given prefix.
+	int list(lua_State *L);
+
+	/// Fills blob with the contents of an entry from this archive's index, decompressing it if needed.
+	void read(Blob *blob, const FileInfo & info) const;
+
+protected:
+	void readCompressed(Blob *blob, const FileInfo & info) const;
+};
 
-	void reload();
+// Keeps the whole archive mapped in memory; blobs read from it are views into the mapping.
+// The file cannot be truncated or replaced while the mapping (or any blob from it) is alive.
+struct MappedResourceDatFile :public ResourceDatFile {
+	MappedResourceDatFile(const std::string & filename);
 };
 
 struct BlobFromResourceDat :public Blob {
 	BlobFromResourceDat(const ResourceDatFile *dat,const std::string & filename);
 };
 
+// Patches a .dat archive without rewriting it. Replacements are appended to the end of the file and
+// only their slots in the offset table are rewritten; the space taken by old versions is reclaimed by compact().
+struct ResourceDatWriter {
+	struct Pending {
+		std::string name;
+		std::vector<unsigned char> data; // as it will be stored, compressed or not
+		bool compressed;
+	};
+
+	ResourceDatFile *dat;
+	std::vector<Pending> pending;
+
+	// why the last commit() or compact() returned -1
+	std::string error;
+
+	// entries put while this is set are stored LZ4 compressed, unless that doesn't make them smaller.
+	// Only archives read through this library can contain compressed entries; the game can't read them.
+	bool compress;
+
+	ResourceDatWriter(ResourceDatFile *dat);
+
+	void put(const std::string & name, Blob *blob);
+
+	/// Writes pending entries and returns the number of bytes written, or -1 on failure.
+	/// Adding names that are not in the archive yet grows the offset table, which needs a full compact().
+	int commit();
+	int commit(lua_State *L);
+
+	/// Rewrites the archive with pending entries and without unreferenced data, returns the new size or -1.
+	/// Fails without writing anything if blobs read from the archive's mapping are still alive.
+	int compact();
+	int compact(lua_State *L);
+};
+
 #endif
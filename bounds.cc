@@ -0,0 +1,81 @@
+#include "bounds.h"
+#include <intrin.h>
+#include <emmintrin.h>
+
+static bool cpuHasSse2() {
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+}
+
+static const bool sse2 = cpuHasSse2();
+
+// index of the first pixel in [from, to) with bits of mask set, or to
+static int firstSet(const unsigned int *row, int from, int to, unsigned int mask) {
+	int x = from;
+
+	if(sse2) {
+		const __m128i m = _mm_set1_epi32(mask);
+		const __m128i zero = _mm_setzero_si128();
+		for(; x + 4 <= to; x += 4) {
+			__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (row + x)), m);
+			int empty = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, zero)));
+			if(empty != 0xf) break;
+		}
+	}
+
+	for(; x < to; x++) {
+		if(row[x] & mask) return x;
+	}
+
+	return to;
+}
+
+// one past the index of the last pixel in [from, to) with bits of mask set, or from
+static int lastSet(const unsigned int *row, int from, int to, unsigned int mask) {
+	int x = to;
+
+	if(sse2) {
+		const __m128i m = _mm_set1_epi32(mask);
+		const __m128i zero = _mm_setzero_si128();
+		for(; x - 4 >= from; x -= 4) {
+			__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (row + x - 4)), m);
+			int empty = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, zero)));
+			if(empty != 0xf) break;
+		}
+	}
+
+	for(; x > from; x--) {
+		if(row[x - 1] & mask) return x;
+	}
+
+	return from;
+}
+
+// Rows are scanned in memory order. Once the first solid row gives a left and right edge, the remaining
+// rows only need to be looked at outside of them, so mostly solid images cost little more than their edges.
+bool findBounds(const unsigned int *pixels, int w, int h, int stride, unsigned int mask, int *left, int *top, int *right, int *bottom) {
+	int y0 = 0;
+	while(y0 < h && firstSet(pixels + y0 * stride, 0, w, mask) == w)
+		y0++;
+
+	if(y0 == h) return false;
+
+	int y1 = h;
+	while(firstSet(pixels + (y1 - 1) * stride, 0, w, mask) == w)
+		y1--;
+
+	int x0 = w;
+	int x1 = 0;
+	for(int y = y0; y < y1; y++) {
+		const unsigned int *row = pixels + y * stride;
+		x0 = firstSet(row, 0, x0, mask);
+		x1 = lastSet(row, x1, w, mask);
+	}
+
+	*left = x0;
+	*top = y0;
+	*right = x1;
+	*bottom = y1;
+	return true;
+}
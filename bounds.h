@@ -0,0 +1,8 @@
+#ifndef __BOUNDS_H__
+#define __BOUNDS_H__
+
+/// Finds the smallest rectangle holding every pixel of a 32 bit image that has any bits of mask set.
+/// stride is in pixels. right and bottom are exclusive; returns false, leaving them alone, if there are no such pixels.
+bool findBounds(const unsigned int *pixels, int w, int h, int stride, unsigned int mask, int *left, int *top, int *right, int *bottom);
+
+#endif
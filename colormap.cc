@@ -0,0 +1,119 @@
+#include "colormap.h"
+#include "xxhash.h"
+#include <algorithm>
+#include <cstring>
+
+// palette swaps rarely map more colors than this
+static const size_t smallMapSize = 8;
+
+static const unsigned int notMapped = 0xffffffff;
+
+ColorMap::ColorMap() {
+	hash = 0;
+	shift = 0;
+	perfect = false;
+}
+
+void ColorMap::add(unsigned int from, unsigned int to) {
+	added.push_back({ from & 0x00ffffff, to & 0x00ffffff });
+}
+
+void ColorMap::finish() {
+	// stable sort keeps pairs for the same color in the order they were added, and the last one wins
+	std::stable_sort(added.begin(), added.end(), [](const Entry & a, const Entry & b) { return a.from < b.from; });
+
+	entries.clear();
+	for(size_t i = 0; i < added.size(); i++) {
+		if(i + 1 == added.size() || added[i + 1].from != added[i].from)
+			entries.push_back(added[i]);
+	}
+	added.clear();
+
+	hash = XXH64(entries.data(), entries.size() * sizeof(Entry), 0);
+
+	// small maps get a table big enough for every color to have a slot of its own, so a lookup is one compare;
+	// if no such size turns up, or the map is large, colliding colors take the following free slot
+	perfect = false;
+	unsigned int bits = 4;
+	while((1u << bits) < entries.size() * 2) bits++;
+
+	if(entries.size() <= smallMapSize) {
+		for(unsigned int tryBits = bits; tryBits <= bits + 6 && !perfect; tryBits++) {
+			std::vector<bool> used(1u << tryBits, false);
+			perfect = true;
+			for(const Entry & entry : entries) {
+				unsigned int slot = (entry.from * 2654435761u) >> (32 - tryBits);
+				if(used[slot]) {
+					perfect = false;
+					break;
+				}
+				used[slot] = true;
+			}
+			if(perfect) bits = tryBits;
+		}
+	}
+
+	shift = 32 - bits;
+	table.assign(1u << bits, { notMapped, 0 });
+	for(const Entry & entry : entries) {
+		unsigned int slot = (entry.from * 2654435761u) >> shift;
+		while(table[slot].from != notMapped)
+			slot = (slot + 1) & (table.size() - 1);
+		table[slot] = entry;
+	}
+}
+
+void ColorMap::apply(const unsigned int *src, unsigned int *dst, int count) const {
+	if(entries.empty()) {
+		if(src != dst)
+			memcpy(dst, src, count * sizeof(unsigned int));
+	} else if(perfect) {
+		applyPerfect(src, dst, count);
+	} else {
+		applyHashed(src, dst, count);
+	}
+}
+
+// neighbouring pixels tend to share a color, so both lookups remember the last one
+void ColorMap::applyPerfect(const unsigned int *src, unsigned int *dst, int count) const {
+	const Entry *slots = table.data();
+	unsigned int lastColor = notMapped;
+	unsigned int lastResult = notMapped;
+
+	for(int i = 0; i < count; i++) {
+		unsigned int pixel = src[i];
+		unsigned int color = pixel & 0x00ffffff;
+
+		if(color != lastColor) {
+			const Entry & entry = slots[(color * 2654435761u) >> shift];
+			lastColor = color;
+			lastResult = entry.from == color ? entry.to : notMapped;
+		}
+
+		dst[i] = lastResult == notMapped ? pixel : lastResult | (pixel & 0xff000000);
+	}
+}
+
+void ColorMap::applyHashed(const unsigned int *src, unsigned int *dst, int count) const {
+	unsigned int lastColor = notMapped;
+	unsigned int lastResult = notMapped;
+	unsigned int tableMask = (unsigned int) table.size() - 1;
+
+	for(int i = 0; i < count; i++) {
+		unsigned int pixel = src[i];
+		unsigned int color = pixel & 0x00ffffff;
+
+		if(color != lastColor) {
+			lastColor = color;
+			lastResult = notMapped;
+			for(unsigned int slot = (color * 2654435761u) >> shift; table[slot].from != notMapped; slot = (slot + 1) & tableMask) {
+				if(table[slot].from == color) {
+					lastResult = table[slot].to;
+					break;
+				}
+			}
+		}
+
+		dst[i] = lastResult == notMapped ? pixel : lastResult | (pixel & 0xff000000);
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef __COLORMAP_H__
+#define __COLORMAP_H__
+
+#include <vector>
+
+// Replaces RGB values of 32 bit RGBA pixels, keeping their alpha.
+struct ColorMap {
+	struct Entry {
+		unsigned int from;
+		unsigned int to;
+	};
+
+	// one entry per source color, sorted by it; later pairs passed to add() override earlier ones
+	std::vector<Entry> entries;
+	std::vector<Entry> added; // pairs not yet merged into entries by finish()
+
+	// identifies the mapping regardless of the order or duplicates it was built from
+	unsigned long long hash;
+
+	ColorMap();
+
+	/// Colors are 0x00bbggrr, alpha is ignored. Call finish() after the last add().
+	void add(unsigned int from, unsigned int to);
+	void finish();
+
+	/// src and dst may be the same buffer.
+	void apply(const unsigned int *src, unsigned int *dst, int count) const;
+
+private:
+	// open addressing table of entries, empty slots have from set to an impossible color
+	std::vector<Entry> table;
+	unsigned int shift;
+	bool perfect; // no two entries share a slot
+
+	void applyPerfect(const unsigned int *src, unsigned int *dst, int count) const;
+	void applyHashed(const unsigned int *src, unsigned int *dst, int count) const;
+};
+
+#endif
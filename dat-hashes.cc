@@ -0,0 +1,406 @@
+#include "dat-hashes.h"
+#include "png-decode.h"
+#include "sdl-utils.h"
+#include "xxhash.h"
+#include "lauxlib.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+
+// version 2 hashes compressed entries by their decompressed contents, version 3 can hold pixel hashes
+static const char sidecarMagic[4] = { 'D', 'X', 'H', '3' };
+
+ResourceDatHashes::ResourceDatHashes(ResourceDatFile *dat) {
+	this->dat = dat;
+	fileSize = 0;
+	fileTime = 0;
+
+	update();
+}
+
+std::string ResourceDatHashes::sidecarName() const {
+	return dat->filename + ".xxh";
+}
+
+bool ResourceDatHashes::update() {
+	if(dat == NULL) return false;
+	if(fileSize == dat->fileSize && fileTime == dat->fileTime && byName.size() == dat->index.size())
+		return false;
+
+	if(loadSidecar() && byName.size() == dat->index.size())
+		return false;
+
+	compute();
+	saveSidecar();
+	return true;
+}
+
+bool ResourceDatHashes::loadSidecar() {
+	FILE *file = fopen(sidecarName().c_str(), "rb");
+	if(file == NULL) return false;
+
+	char magic[4];
+	unsigned long long size, time;
+	unsigned int count, hasPixels;
+	bool ok = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, sidecarMagic, sizeof(magic)) == 0 &&
+		fread(&size, sizeof(size), 1, file) == 1 && fread(&time, sizeof(time), 1, file) == 1 &&
+		fread(&count, sizeof(count), 1, file) == 1 && fread(&hasPixels, sizeof(hasPixels), 1, file) == 1 &&
+		size == dat->fileSize && time == dat->fileTime;
+
+	if(ok) {
+		byName.clear();
+		byName.reserve(count, count * 40);
+		pixelHashes.clear();
+
+		std::vector<char> name;
+		for(unsigned int i = 0; i < count && ok; i++) {
+			unsigned long long hash, pixelHash;
+			unsigned int namesize;
+			ok = fread(&hash, sizeof(hash), 1, file) == 1 &&
+				(!hasPixels || fread(&pixelHash, sizeof(pixelHash), 1, file) == 1) &&
+				fread(&namesize, sizeof(namesize), 1, file) == 1 && namesize <= 0xffff;
+			if(!ok) break;
+			if(hasPixels) pixelHashes.push_back(pixelHash);
+
+			name.resize(namesize);
+			ok = namesize == 0 || fread(name.data(), namesize, 1, file) == 1;
+			if(ok) byName.insert(name.data(), namesize, hash);
+		}
+	}
+
+	fclose(file);
+
+	if(!ok) {
+		byName.clear();
+		byHash.clear();
+		pixelHashes.clear();
+		byPixelHash.clear();
+		return false;
+	}
+
+	fileSize = dat->fileSize;
+	fileTime = dat->fileTime;
+	rebuildByHash();
+	return true;
+}
+
+void ResourceDatHashes::saveSidecar() const {
+	std::string filename = sidecarName();
+	std::string tempname = filename + ".tmp";
+
+	FILE *file = fopen(tempname.c_str(), "wb");
+	if(file == NULL) return;
+
+	unsigned int count = (unsigned int) byName.size();
+	unsigned int hasPixels = pixelHashes.size() == count && count > 0;
+	bool ok = fwrite(sidecarMagic, sizeof(sidecarMagic), 1, file) == 1 &&
+		fwrite(&fileSize, sizeof(fileSize), 1, file) == 1 && fwrite(&fileTime, sizeof(fileTime), 1, file) == 1 &&
+		fwrite(&count, sizeof(count), 1, file) == 1 && fwrite(&hasPixels, sizeof(hasPixels), 1, file) == 1;
+
+	for(unsigned int i = 0; i < count && ok; i++) {
+		const auto & entry = byName.entries[i];
+		ok = fwrite(&entry.value, sizeof(entry.value), 1, file) == 1 &&
+			(!hasPixels || fwrite(&pixelHashes[i], sizeof(pixelHashes[i]), 1, file) == 1) &&
+			fwrite(&entry.nameLength, sizeof(entry.nameLength), 1, file) == 1 &&
+			(entry.nameLength == 0 || fwrite(byName.pool.data() + entry.nameOffset, entry.nameLength, 1, file) == 1);
+	}
+
+	if(fclose(file) != 0) ok = false;
+
+	// a half-written sidecar would just fail to load, but there's no reason to leave one around
+	if(!ok || !MoveFileExA(tempname.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+		DeleteFileA(tempname.c_str());
+}
+
+void ResourceDatHashes::compute() {
+	struct Job {
+		unsigned int entry;
+		size_t offset;
+		size_t size;
+		bool compressed;
+		unsigned long long hash;
+	};
+
+	const auto & entries = dat->index.entries;
+	std::shared_ptr<MappedFile> mapping = dat->mapping;
+
+	// hashing in file order keeps reads sequential within each thread
+	std::vector<Job> jobs(entries.size());
+	for(unsigned int i = 0; i < entries.size(); i++) {
+		jobs[i].entry = i;
+		jobs[i].offset = entries[i].value.offset;
+		jobs[i].size = entries[i].value.size;
+		jobs[i].compressed = entries[i].value.compressed;
+		jobs[i].hash = 0;
+	}
+	std::sort(jobs.begin(), jobs.end(), [](const Job & a, const Job & b) { return a.offset < b.offset; });
+
+	// a hash identifies contents however they are stored, so compressed entries are hashed decompressed
+	auto hashCompressed = [&](Job & job) {
+		Blob blob;
+		dat->read(&blob, entries[job.entry].value);
+		job.hash = XXH64(blob.data, blob.length, 0);
+	};
+
+	auto work = [&](size_t begin, size_t end) {
+		if(mapping) {
+			for(size_t i = begin; i < end; i++) {
+				if(jobs[i].compressed)
+					hashCompressed(jobs[i]);
+				else
+					jobs[i].hash = XXH64(mapping->view + jobs[i].offset, jobs[i].size, 0);
+			}
+			return;
+		}
+
+		FILE *file = fopen(dat->filename.c_str(), "rb");
+		if(file == NULL) return;
+
+		XXH64_state_t *state = XXH64_createState();
+		std::vector<unsigned char> buffer(64 * 1024);
+		for(size_t i = begin; i < end; i++) {
+			if(jobs[i].compressed) {
+				hashCompressed(jobs[i]);
+				continue;
+			}
+
+			XXH64_reset(state, 0);
+			fseek(file, (long) jobs[i].offset, SEEK_SET);
+
+			size_t left = jobs[i].size;
+			while(left > 0) {
+				size_t count = fread(buffer.data(), 1, std::min(left, buffer.size()), file);
+				if(count == 0) break;
+				XXH64_update(state, buffer.data(), count);
+				left -= count;
+			}
+			jobs[i].hash = XXH64_digest(state);
+		}
+		XXH64_freeState(state);
+
+		fclose(file);
+	};
+
+	// small archives aren't worth starting threads for
+	size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, jobs.size() / 64 + 1);
+
+	std::vector<std::thread> threads;
+	for(size_t t = 1; t < threadCount; t++)
+		threads.emplace_back(work, jobs.size() * t / threadCount, jobs.size() * (t + 1) / threadCount);
+	work(0, jobs.size() / threadCount);
+	for(std::thread & thread : threads)
+		thread.join();
+
+	std::sort(jobs.begin(), jobs.end(), [](const Job & a, const Job & b) { return a.entry < b.entry; });
+
+	byName.clear();
+	byName.reserve(entries.size(), dat->index.pool.size());
+	for(const Job & job : jobs) {
+		const auto & entry = entries[job.entry];
+		byName.insert(dat->index.pool.data() + entry.nameOffset, entry.nameLength, job.hash);
+	}
+
+	fileSize = dat->fileSize;
+	fileTime = dat->fileTime;
+	pixelHashes.clear();
+	rebuildByHash();
+}
+
+void ResourceDatHashes::updatePixels() {
+	if(pixelHashes.size() == byName.size()) return;
+
+	computePixels();
+	saveSidecar();
+}
+
+void ResourceDatHashes::computePixels() {
+	struct Job {
+		const ResourceDatFile::FileInfo *info;
+		unsigned long long hash;
+	};
+
+	std::vector<Job> jobs(byName.entries.size());
+	for(size_t i = 0; i < jobs.size(); i++) {
+		jobs[i].info = dat->index.find(byName.name(byName.entries[i]));
+		jobs[i].hash = 0;
+	}
+
+	// hashed exactly like glTexImage2D uploads are, so they can be looked up in lastFrameMap
+	auto work = [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			if(jobs[i].info == NULL) continue;
+
+			Blob blob;
+			dat->read(&blob, *jobs[i].info);
+			if(!pngSignature(blob.data, blob.length)) continue;
+
+			int w, h;
+			unsigned char *pixels = pngDecode(blob.data, blob.length, &w, &h);
+			if(pixels == NULL) continue;
+
+			jobs[i].hash = XXH64(pixels, (size_t) w * h * 4, 0);
+			delete[] pixels;
+		}
+	};
+
+	size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, jobs.size() / 16 + 1);
+
+	std::vector<std::thread> threads;
+	for(size_t t = 1; t < threadCount; t++)
+		threads.emplace_back(work, jobs.size() * t / threadCount, jobs.size() * (t + 1) / threadCount);
+	work(0, jobs.size() / threadCount);
+	for(std::thread & thread : threads)
+		thread.join();
+
+	pixelHashes.resize(jobs.size());
+	for(size_t i = 0; i < jobs.size(); i++)
+		pixelHashes[i] = jobs[i].hash;
+
+	rebuildByHash();
+}
+
+void ResourceDatHashes::rebuildByHash() {
+	byHash.clear();
+	byHash.reserve(byName.size());
+	for(unsigned int i = 0; i < byName.entries.size(); i++)
+		byHash.emplace(byName.entries[i].value, i);
+
+	byPixelHash.clear();
+	byPixelHash.reserve(pixelHashes.size());
+	for(unsigned int i = 0; i < pixelHashes.size(); i++) {
+		if(pixelHashes[i] != 0)
+			byPixelHash.emplace(pixelHashes[i], i);
+	}
+}
+
+bool ResourceDatHashes::find(const std::string & name, unsigned long long & hash) const {
+	const unsigned long long *found = byName.find(name);
+	if(found == NULL) return false;
+
+	hash = *found;
+	return true;
+}
+
+std::vector<std::string> ResourceDatHashes::namesOf(unsigned long long hash) const {
+	std::vector<std::string> result;
+
+	auto range = byHash.equal_range(hash);
+	for(auto i = range.first; i != range.second; ++i)
+		result.push_back(byName.name(byName.entries[i->second]));
+
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+bool ResourceDatHashes::findPixels(const std::string & name, unsigned long long & hash) {
+	const auto *found = byName.findEntry(name.data(), name.size());
+	if(found == NULL) return false;
+
+	updatePixels();
+
+	hash = pixelHashes[found - byName.entries.data()];
+	return hash != 0;
+}
+
+std::vector<std::string> ResourceDatHashes::namesOfPixels(unsigned long long hash) {
+	updatePixels();
+
+	std::vector<std::string> result;
+
+	auto range = byPixelHash.equal_range(hash);
+	for(auto i = range.first; i != range.second; ++i)
+		result.push_back(byName.name(byName.entries[i->second]));
+
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+static void pushHash(lua_State *L, unsigned long long value) {
+	char text[17];
+	sprintf(text, "%016llx", value);
+	lua_pushstring(L, text);
+}
+
+static void pushNames(lua_State *L, const std::vector<std::string> & names) {
+	lua_createtable(L, (int) names.size(), 0);
+	for(size_t i = 0; i < names.size(); i++) {
+		lua_pushlstring(L, names[i].data(), names[i].size());
+		lua_rawseti(L, -2, (int) i + 1);
+	}
+}
+
+int ResourceDatHashes::hash(lua_State *L) {
+	std::string name = luaL_checkstring(L, 2);
+
+	unsigned long long value;
+	if(!find(name, value)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	pushHash(L, value);
+	return 1;
+}
+
+int ResourceDatHashes::names(lua_State *L) {
+	const char *text = luaL_checkstring(L, 2);
+	unsigned long long value = _strtoui64(text, NULL, 16);
+
+	pushNames(L, namesOf(value));
+	return 1;
+}
+
+int ResourceDatHashes::pixelHash(lua_State *L) {
+	std::string name = luaL_checkstring(L, 2);
+
+	unsigned long long value;
+	if(!findPixels(name, value)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	pushHash(L, value);
+	return 1;
+}
+
+int ResourceDatHashes::pixelNames(lua_State *L) {
+	const char *text = luaL_checkstring(L, 2);
+	unsigned long long value = _strtoui64(text, NULL, 16);
+
+	pushNames(L, namesOfPixels(value));
+	return 1;
+}
+
+int ResourceDatHashes::wasDrawn(lua_State *L) {
+	std::string name = luaL_checkstring(L, 2);
+
+	unsigned long long value;
+	auto iter = findPixels(name, value) ? SDL::lastFrameMap.find(value) : SDL::lastFrameMap.end();
+	if(iter == SDL::lastFrameMap.end()) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+
+	lua_pushboolean(L, 1);
+	lua_pushnumber(L, iter->second.x);
+	lua_pushnumber(L, iter->second.y);
+	return 3;
+}
+
+int ResourceDatHashes::drawn(lua_State *L) {
+	updatePixels();
+
+	std::vector<std::string> result;
+	for(const auto & frame : SDL::lastFrameMap) {
+		auto range = byPixelHash.equal_range(frame.first);
+		for(auto i = range.first; i != range.second; ++i)
+			result.push_back(byName.name(byName.entries[i->second]));
+	}
+
+	std::sort(result.begin(), result.end());
+	pushNames(L, result);
+	return 1;
+}
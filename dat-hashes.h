@@ -0,0 +1,61 @@
+#ifndef __DAT_HASHES_H__
+#define __DAT_HASHES_H__
+
+#include "blob.h"
+#include "path-index.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// XXH64 of every entry in a .dat archive, computed in parallel and cached in a sidecar file next to the
+// archive (<archive>.xxh). The sidecar is only trusted while the archive's size and modification time match.
+// Hashes of decoded pixels, the same ones textures the game uploads are tracked by, are only computed once
+// they are asked for, as that means decoding every image.
+struct ResourceDatHashes {
+	ResourceDatFile *dat;
+
+	// archive identity the hashes were computed for
+	unsigned long long fileSize;
+	unsigned long long fileTime;
+
+	PathIndex<unsigned long long> byName;
+	std::unordered_multimap<unsigned long long, unsigned int> byHash; // hash -> position in byName.entries
+
+	// XXH64 of the RGBA pixels of every PNG, in the order of byName.entries; 0 for entries that aren't
+	// images the in-tree decoder reads. Empty until pixel hashes are first needed
+	std::vector<unsigned long long> pixelHashes;
+	std::unordered_multimap<unsigned long long, unsigned int> byPixelHash;
+
+	ResourceDatHashes(ResourceDatFile *dat);
+
+	/// Recomputes hashes if the archive changed since they were computed, returns true if anything was recomputed.
+	bool update();
+
+	bool find(const std::string & name, unsigned long long & hash) const;
+	std::vector<std::string> namesOf(unsigned long long hash) const;
+
+	bool findPixels(const std::string & name, unsigned long long & hash);
+	std::vector<std::string> namesOfPixels(unsigned long long hash);
+
+	// Lua side sees hashes as 16 digit hex strings, since numbers can't hold 64 bits
+	int hash(lua_State *L);
+	int names(lua_State *L);
+	int pixelHash(lua_State *L);
+	int pixelNames(lua_State *L);
+
+	// entries whose pixels the game drew in the previous frame
+	int wasDrawn(lua_State *L);
+	int drawn(lua_State *L);
+
+	std::string sidecarName() const;
+
+protected:
+	bool loadSidecar();
+	void saveSidecar() const;
+	void compute();
+	void updatePixels();
+	void computePixels();
+	void rebuildByHash();
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include "decode.h"
+#include "swizzle.h"
+#include "utils.h"
+#include "png-decode.h"
+#include "qoi.h"
+#include "image-cache.h"
+#include "Gdiplus.h"
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+static unsigned char *decodeBitmap(Gdiplus::Bitmap *bitmap, int *w, int *h) {
+	if(bitmap == NULL) return NULL;
+
+	unsigned char *pixels = NULL;
+	if(bitmap->GetLastStatus() == Gdiplus::Ok) {
+		Gdiplus::BitmapData bitmapData;
+		Gdiplus::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
+
+		if(bitmap->LockBits(&rect, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &bitmapData) == Gdiplus::Ok) {
+			pixels = new unsigned char[rect.Width * rect.Height * 4];
+			swizzleRows(pixels, (unsigned char *) bitmapData.Scan0, rect.Width, rect.Height, bitmapData.Stride);
+
+			*w = rect.Width;
+			*h = rect.Height;
+
+			bitmap->UnlockBits(&bitmapData);
+		}
+	}
+
+	delete bitmap;
+	return pixels;
+}
+
+static bool readWholeFile(const std::string & filename, std::vector<unsigned char> & contents) {
+	FILE *file = fopen(filename.c_str(), "rb");
+	if(file == NULL) return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	bool ok = size > 0;
+	if(ok) {
+		contents.resize(size);
+		ok = fread(contents.data(), 1, size, file) == (size_t) size;
+	}
+
+	fclose(file);
+	return ok;
+}
+
+// QOI images are always decoded by qoi.cc. With ITBLUA_PNG_DECODER defined, PNGs are decoded by png-decode.cc
+// straight into RGBA, and GDI+ is only used for other formats and for the PNGs that decoder refuses.
+static unsigned char *decodeInMemory(const unsigned char *data, size_t size, int *w, int *h) {
+	if(qoiSignature(data, size))
+		return qoiDecode(data, size, w, h);
+
+#ifdef ITBLUA_PNG_DECODER
+	if(pngSignature(data, size))
+		return pngDecode(data, size, w, h);
+#endif
+
+	return NULL;
+}
+
+unsigned char *decodeImage(const std::string & filename, int *w, int *h) {
+	std::vector<unsigned char> contents;
+	if(readWholeFile(filename, contents)) {
+		unsigned char *pixels = decodeInMemory(contents.data(), contents.size(), w, h);
+		if(pixels != NULL) return pixels;
+	}
+
+	std::wstring ws = s2ws(filename);
+
+	return decodeBitmap(Gdiplus::Bitmap::FromFile(ws.c_str(), false), w, h);
+}
+
+unsigned char *decodeImage(Blob *blob, int *w, int *h) {
+	unsigned char *pixels;
+	if(blob->data != NULL) {
+		pixels = decodeInMemory(blob->data, blob->length, w, h);
+	} else {
+		// streamed blobs are read into memory once here, as GDI+ is the only decoder that reads streams
+		std::vector<unsigned char> contents(blob->length);
+		ULONG read = 0;
+		blob->reset();
+		blob->Read(contents.data(), blob->length, &read);
+		blob->reset();
+
+		pixels = decodeInMemory(contents.data(), read, w, h);
+	}
+	if(pixels != NULL) return pixels;
+
+	return decodeBitmap(Gdiplus::Bitmap::FromStream(blob, false), w, h);
+}
+
+DecodeJob::DecodeJob() {
+	pixels = NULL;
+	width = 0;
+	height = 0;
+	hash = 0;
+	state = PENDING;
+	queued = false;
+}
+
+DecodeJob::~DecodeJob() {
+	if(pixels != NULL && !cached)
+		delete[] pixels;
+}
+
+void DecodeJob::run() {
+	bool ok;
+	if(filename.empty())
+		ok = ImageCache::decode(&blob, &pixels, &width, &height, &hash, cached);
+	else
+		ok = ImageCache::decode(filename, &pixels, &width, &height, &hash, cached);
+
+	state = ok ? DONE : FAILED;
+}
+
+// shared with the workers and never destroyed, as detached workers may still be waiting on it when the process exits
+struct DecodeWorkers {
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::deque<std::shared_ptr<DecodeJob>> jobs;
+
+	int count;
+	int running;
+	size_t capacity;
+
+	DecodeWorkers() {
+		count = 2;
+		running = 0;
+		capacity = 64;
+	}
+};
+
+static DecodeWorkers & workers() {
+	static DecodeWorkers *instance = new DecodeWorkers;
+	return *instance;
+}
+
+// workers are numbered from 0; when the count is lowered, the ones numbered past it stop once idle
+static void decodeWorker(int index) {
+	DecodeWorkers & w = workers();
+	std::unique_lock<std::mutex> lock(w.mutex);
+
+	for(;;) {
+		w.jobAvailable.wait(lock, [&w, index] { return !w.jobs.empty() || index >= w.count; });
+		if(index >= w.count) {
+			// the wakeup may have been meant for a job, pass it on to a worker that stays
+			if(!w.jobs.empty()) w.jobAvailable.notify_one();
+			break;
+		}
+
+		std::shared_ptr<DecodeJob> job = w.jobs.front();
+		w.jobs.pop_front();
+
+		lock.unlock();
+		job->run();
+		job.reset();
+		lock.lock();
+	}
+
+	w.running--;
+}
+
+bool DecodeQueue::push(std::shared_ptr<DecodeJob> job) {
+	DecodeWorkers & w = workers();
+	std::lock_guard<std::mutex> lock(w.mutex);
+
+	if(w.jobs.size() >= w.capacity) return false;
+	w.jobs.push_back(job);
+	job->queued = true;
+
+	while(w.running < w.count)
+		std::thread(decodeWorker, w.running++).detach();
+
+	w.jobAvailable.notify_one();
+	return true;
+}
+
+void DecodeQueue::setWorkers(int count) {
+	DecodeWorkers & w = workers();
+	std::lock_guard<std::mutex> lock(w.mutex);
+
+	w.count = count < 1 ? 1 : count;
+	w.jobAvailable.notify_all();
+}
+
+void DecodeQueue::setCapacity(int jobs) {
+	DecodeWorkers & w = workers();
+	std::lock_guard<std::mutex> lock(w.mutex);
+
+	w.capacity = jobs < 1 ? 1 : jobs;
+}
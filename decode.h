@@ -0,0 +1,49 @@
+#ifndef __DECODE_H__
+#define __DECODE_H__
+
+#include <windows.h>
+#include <string>
+#include <memory>
+#include <atomic>
+#include "blob.h"
+
+struct CachedImage;
+
+// Image decoding shared by all ways of making a surface from a file. Decoded images are 32 bit RGBA
+// pixels, row by row without padding, in an array the caller owns. Safe to call from any thread.
+
+unsigned char *decodeImage(const std::string & filename, int *w, int *h);
+unsigned char *decodeImage(Blob *blob, int *w, int *h);
+
+// A decode running on one of DecodeQueue's workers. Whoever made it polls state, and takes pixels when done.
+struct DecodeJob {
+	enum State { PENDING, DONE, FAILED };
+
+	std::string filename;
+	Blob blob; // decoded instead of the file when filename is empty; owns a copy of its bytes
+
+	unsigned char *pixels; // points into cached if that is set, see ImageCache::decode()
+	int width, height;
+	unsigned long long hash;
+	std::shared_ptr<CachedImage> cached;
+
+	std::atomic<int> state;
+	bool queued; // false until DecodeQueue took it; only used by whoever made the job
+
+	DecodeJob();
+	~DecodeJob();
+
+	void run();
+};
+
+// Decodes images on background threads. Workers are started as jobs come in, up to the configured count.
+struct DecodeQueue {
+	/// Returns false without queueing job if the queue is full, so loading a lot of images at once can't use
+	/// unlimited memory; the caller pushes it again later. Never waits.
+	static bool push(std::shared_ptr<DecodeJob> job);
+
+	static void setWorkers(int count);
+	static void setCapacity(int jobs);
+};
+
+#endif
@@ -0,0 +1,426 @@
+#include "deflate.h"
+#include <cstring>
+#include <algorithm>
+
+static const int windowSize = 32768;
+static const int minMatch = 4; // matches are found by hashing 4 bytes; shorter ones rarely pay for themselves
+static const int maxMatch = 258;
+static const int hashBits = 15;
+static const int maxChain = 8;
+static const size_t blockTokens = 1 << 15;
+
+static const unsigned short lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distanceBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distanceExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// symbol of every match length, and of every distance: the first 256 directly, longer ones by (distance - 1) >> 7
+struct SymbolTables {
+	unsigned char length[maxMatch + 1];
+	unsigned char nearDistance[256];
+	unsigned char farDistance[256];
+
+	SymbolTables() {
+		for(int s = 0; s < 29; s++)
+			for(int l = lengthBase[s]; l < lengthBase[s] + (1 << lengthExtra[s]) && l <= maxMatch; l++)
+				length[l] = (unsigned char) s;
+
+		for(int s = 0; s < 30; s++) {
+			for(int d = distanceBase[s]; d < distanceBase[s] + (1 << distanceExtra[s]); d++) {
+				if(d <= 256)
+					nearDistance[d - 1] = (unsigned char) s;
+				else
+					farDistance[(d - 1) >> 7] = (unsigned char) s;
+			}
+		}
+	}
+
+	int distance(int d) const {
+		return d <= 256 ? nearDistance[d - 1] : farDistance[(d - 1) >> 7];
+	}
+};
+
+static const SymbolTables & symbols() {
+	static const SymbolTables tables;
+	return tables;
+}
+
+struct Token {
+	unsigned short length; // 0 for a literal
+	unsigned short value;  // the literal, or the distance of a match
+};
+
+static unsigned int hash4(const unsigned char *p) {
+	unsigned int value;
+	memcpy(&value, p, 4);
+	return (value * 2654435761u) >> (32 - hashBits);
+}
+
+static int matchLength(const unsigned char *a, const unsigned char *b, int limit) {
+	int n = 0;
+	while(n + 8 <= limit) {
+		unsigned long long x, y;
+		memcpy(&x, a + n, 8);
+		memcpy(&y, b + n, 8);
+		if(x != y) break;
+		n += 8;
+	}
+	while(n < limit && a[n] == b[n])
+		n++;
+	return n;
+}
+
+// greedy LZ77: at every position takes the longest match among the last few with the same hash
+static void findTokens(const unsigned char *source, int size, std::vector<Token> & tokens) {
+	std::vector<int> head(1 << hashBits, -1);
+	std::vector<int> previous(windowSize); // earlier position with the same hash, by position within the window
+
+	int i = 0;
+	while(i < size) {
+		int bestLength = 0;
+		int bestDistance = 0;
+
+		if(i + minMatch <= size) {
+			unsigned int h = hash4(source + i);
+			int limit = std::min(maxMatch, size - i);
+
+			int candidate = head[h];
+			for(int chain = 0; candidate >= 0 && i - candidate <= windowSize && chain < maxChain; chain++) {
+				if(source[candidate + bestLength] == source[i + bestLength]) {
+					int length = matchLength(source + candidate, source + i, limit);
+					if(length > bestLength) {
+						bestLength = length;
+						bestDistance = i - candidate;
+						if(length == limit) break;
+					}
+				}
+				candidate = previous[candidate & (windowSize - 1)];
+			}
+
+			previous[i & (windowSize - 1)] = head[h];
+			head[h] = i;
+		}
+
+		if(bestLength < minMatch) {
+			Token token = { 0, source[i] };
+			tokens.push_back(token);
+			i++;
+			continue;
+		}
+
+		Token token = { (unsigned short) bestLength, (unsigned short) bestDistance };
+		tokens.push_back(token);
+
+		for(int end = i + bestLength, j = i + 1; j < end && j + minMatch <= size; j++) {
+			unsigned int h = hash4(source + j);
+			previous[j & (windowSize - 1)] = head[h];
+			head[h] = j;
+		}
+		i += bestLength;
+	}
+}
+
+// Huffman code lengths no longer than maxLength for the given frequencies, 0 for unused symbols. At least two
+// symbols always get a code, as some decoders don't accept a code with only one.
+static void buildLengths(const unsigned int *frequencies, int count, int maxLength, unsigned char *lengths) {
+	std::vector<unsigned int> freq(frequencies, frequencies + count);
+
+	int used = 0;
+	for(int i = 0; i < count; i++)
+		if(freq[i] != 0) used++;
+	for(int i = 0; i < count && used < 2; i++) {
+		if(freq[i] == 0) {
+			freq[i] = 1;
+			used++;
+		}
+	}
+
+	struct Node {
+		unsigned int freq;
+		int parent;
+	};
+
+	for(;;) {
+		std::vector<std::pair<unsigned int, int>> leaves;
+		for(int i = 0; i < count; i++)
+			if(freq[i] != 0) leaves.push_back(std::make_pair(freq[i], i));
+		std::sort(leaves.begin(), leaves.end());
+
+		// leaves sorted by frequency come first, internal nodes are made in order of frequency after them, so
+		// the two least frequent nodes are always at the front of one of those two queues
+		int n = (int) leaves.size();
+		std::vector<Node> nodes(2 * n - 1);
+		for(int i = 0; i < n; i++)
+			nodes[i].freq = leaves[i].first;
+
+		int nextLeaf = 0, nextInternal = n;
+		for(int k = n; k < 2 * n - 1; k++) {
+			int pick[2];
+			for(int j = 0; j < 2; j++) {
+				if(nextLeaf < n && (nextInternal >= k || nodes[nextLeaf].freq <= nodes[nextInternal].freq))
+					pick[j] = nextLeaf++;
+				else
+					pick[j] = nextInternal++;
+			}
+
+			nodes[k].freq = nodes[pick[0]].freq + nodes[pick[1]].freq;
+			nodes[pick[0]].parent = k;
+			nodes[pick[1]].parent = k;
+		}
+
+		// parents come after their children, so depths are known walking back from the root
+		std::vector<int> depth(2 * n - 1, 0);
+		int deepest = 0;
+		for(int k = 2 * n - 3; k >= 0; k--) {
+			depth[k] = depth[nodes[k].parent] + 1;
+			deepest = std::max(deepest, depth[k]);
+		}
+
+		if(deepest <= maxLength) {
+			memset(lengths, 0, count);
+			for(int i = 0; i < n; i++)
+				lengths[leaves[i].second] = (unsigned char) depth[i];
+			return;
+		}
+
+		// flatter frequencies make a shallower tree; this is rare enough not to need an optimal method
+		for(int i = 0; i < count; i++)
+			if(freq[i] != 0) freq[i] = (freq[i] >> 1) | 1;
+	}
+}
+
+// canonical codes for lengths, bit reversed as deflate sends codes starting from their highest bit
+static void buildCodes(const unsigned char *lengths, int count, unsigned short *codes) {
+	int sizes[16] = { 0 };
+	for(int i = 0; i < count; i++)
+		sizes[lengths[i]]++;
+	sizes[0] = 0;
+
+	int nextCode[16];
+	int code = 0;
+	for(int i = 1; i < 16; i++) {
+		code = (code + sizes[i - 1]) << 1;
+		nextCode[i] = code;
+	}
+
+	for(int i = 0; i < count; i++) {
+		int length = lengths[i];
+		if(length == 0) continue;
+
+		int value = nextCode[length]++;
+		int reversed = 0;
+		for(int b = 0; b < length; b++) {
+			reversed = (reversed << 1) | (value & 1);
+			value >>= 1;
+		}
+		codes[i] = (unsigned short) reversed;
+	}
+}
+
+struct BitWriter {
+	std::vector<unsigned char> & out;
+	unsigned long long bits;
+	int count;
+
+	BitWriter(std::vector<unsigned char> & out) :out(out) {
+		bits = 0;
+		count = 0;
+	}
+
+	void put(unsigned int value, int n) {
+		bits |= (unsigned long long) value << count;
+		count += n;
+		if(count >= 32) {
+			for(int i = 0; i < 4; i++)
+				out.push_back((unsigned char) (bits >> (i * 8)));
+			bits >>= 32;
+			count -= 32;
+		}
+	}
+
+	// pads with zero bits to a byte boundary and writes out everything
+	void flush() {
+		while(count > 0) {
+			out.push_back((unsigned char) bits);
+			bits >>= 8;
+			count -= 8;
+		}
+		bits = 0;
+		count = 0;
+	}
+};
+
+static void writeBlock(BitWriter & w, const Token *tokens, size_t count, bool final) {
+	static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	const SymbolTables & tables = symbols();
+
+	unsigned int literalFreq[286] = { 0 };
+	unsigned int distanceFreq[30] = { 0 };
+	for(size_t i = 0; i < count; i++) {
+		if(tokens[i].length == 0) {
+			literalFreq[tokens[i].value]++;
+		} else {
+			literalFreq[257 + tables.length[tokens[i].length]]++;
+			distanceFreq[tables.distance(tokens[i].value)]++;
+		}
+	}
+	literalFreq[256] = 1;
+
+	unsigned char lengths[286 + 30];
+	buildLengths(literalFreq, 286, 15, lengths);
+	int literalCount = 286;
+	while(literalCount > 257 && lengths[literalCount - 1] == 0)
+		literalCount--;
+
+	unsigned char distanceLengths[30];
+	buildLengths(distanceFreq, 30, 15, distanceLengths);
+	int distanceCount = 30;
+	while(distanceCount > 1 && distanceLengths[distanceCount - 1] == 0)
+		distanceCount--;
+
+	unsigned short literalCodes[286], distanceCodes[30];
+	buildCodes(lengths, 286, literalCodes);
+	buildCodes(distanceLengths, 30, distanceCodes);
+
+	// both sets of lengths are sent as one sequence, with runs shortened by codes 16 to 18
+	memcpy(lengths + literalCount, distanceLengths, distanceCount);
+	int total = literalCount + distanceCount;
+
+	unsigned char runSymbols[286 + 30];
+	unsigned char runExtra[286 + 30];
+	int runCount = 0;
+	for(int i = 0; i < total;) {
+		int value = lengths[i];
+		int run = 1;
+		while(i + run < total && lengths[i + run] == value)
+			run++;
+
+		int symbol = value, extra = 0, step = 1;
+		if(value == 0 && run >= 11) {
+			step = std::min(run, 138);
+			symbol = 18;
+			extra = step - 11;
+		} else if(value == 0 && run >= 3) {
+			step = run;
+			symbol = 17;
+			extra = step - 3;
+		} else if(value != 0 && i > 0 && lengths[i - 1] == value && run >= 3) {
+			step = std::min(run, 6);
+			symbol = 16;
+			extra = step - 3;
+		}
+
+		runSymbols[runCount] = (unsigned char) symbol;
+		runExtra[runCount] = (unsigned char) extra;
+		runCount++;
+		i += step;
+	}
+
+	unsigned int codeLengthFreq[19] = { 0 };
+	for(int i = 0; i < runCount; i++)
+		codeLengthFreq[runSymbols[i]]++;
+
+	unsigned char codeLengthLengths[19];
+	unsigned short codeLengthCodes[19];
+	buildLengths(codeLengthFreq, 19, 7, codeLengthLengths);
+	buildCodes(codeLengthLengths, 19, codeLengthCodes);
+
+	int codeLengthCount = 19;
+	while(codeLengthCount > 4 && codeLengthLengths[order[codeLengthCount - 1]] == 0)
+		codeLengthCount--;
+
+	w.put(final ? 1 : 0, 1);
+	w.put(2, 2);
+	w.put(literalCount - 257, 5);
+	w.put(distanceCount - 1, 5);
+	w.put(codeLengthCount - 4, 4);
+	for(int i = 0; i < codeLengthCount; i++)
+		w.put(codeLengthLengths[order[i]], 3);
+
+	static const int repeatBits[3] = { 2, 3, 7 };
+	for(int i = 0; i < runCount; i++) {
+		int symbol = runSymbols[i];
+		w.put(codeLengthCodes[symbol], codeLengthLengths[symbol]);
+		if(symbol >= 16)
+			w.put(runExtra[i], repeatBits[symbol - 16]);
+	}
+
+	for(size_t i = 0; i < count; i++) {
+		const Token & token = tokens[i];
+		if(token.length == 0) {
+			w.put(literalCodes[token.value], lengths[token.value]);
+			continue;
+		}
+
+		int symbol = tables.length[token.length];
+		w.put(literalCodes[257 + symbol], lengths[257 + symbol]);
+		w.put(token.length - lengthBase[symbol], lengthExtra[symbol]);
+
+		symbol = tables.distance(token.value);
+		w.put(distanceCodes[symbol], distanceLengths[symbol]);
+		w.put(token.value - distanceBase[symbol], distanceExtra[symbol]);
+	}
+
+	w.put(literalCodes[256], lengths[256]);
+}
+
+void deflatePiece(const unsigned char *source, size_t size, bool last, std::vector<unsigned char> & out) {
+	std::vector<Token> tokens;
+	tokens.reserve(size / 4 + 16);
+	findTokens(source, (int) size, tokens);
+
+	BitWriter w(out);
+	size_t start = 0;
+	do {
+		size_t count = std::min(blockTokens, tokens.size() - start);
+		bool final = last && start + count == tokens.size();
+		writeBlock(w, tokens.data() + start, count, final);
+		start += count;
+	} while(start < tokens.size());
+
+	// an empty stored block ends the piece on a byte boundary, so the next one can simply be appended
+	if(!last) {
+		w.put(0, 3);
+		w.flush();
+		w.put(0xffff0000, 32);
+	}
+	w.flush();
+}
+
+static const unsigned int adlerBase = 65521;
+
+unsigned int adler32(const unsigned char *data, size_t size, unsigned int adler) {
+	unsigned int a = adler & 0xffff;
+	unsigned int b = adler >> 16;
+
+	// 5552 is the most bytes that can be summed before b could overflow
+	while(size > 0) {
+		size_t n = std::min(size, (size_t) 5552);
+		size -= n;
+		for(size_t i = 0; i < n; i++) {
+			a += data[i];
+			b += a;
+		}
+		data += n;
+		a %= adlerBase;
+		b %= adlerBase;
+	}
+
+	return (b << 16) | a;
+}
+
+unsigned int adler32Combine(unsigned int first, unsigned int second, size_t secondSize) {
+	unsigned int remainder = (unsigned int) (secondSize % adlerBase);
+
+	unsigned int a = (first & 0xffff) + (second & 0xffff) + adlerBase - 1;
+	unsigned long long b = (unsigned long long) remainder * (first & 0xffff) % adlerBase;
+	b += (first >> 16) + (second >> 16) + adlerBase - remainder;
+
+	return (unsigned int) (b % adlerBase) << 16 | (a % adlerBase);
+}
@@ -0,0 +1,21 @@
+#ifndef __DEFLATE_H__
+#define __DEFLATE_H__
+
+#include <cstddef>
+#include <vector>
+
+// Fast deflate compressor (RFC 1951), the counterpart of inflate.cc. It trades some compression for speed:
+// matches are found with a short hash chain and every block gets its own Huffman codes.
+//
+// Input can be split into pieces compressed independently, on different threads, and concatenated in order:
+// every piece but the last ends on a byte boundary, like zlib's sync flush, and matches never reach back
+// into an earlier piece.
+
+/// Appends the compressed piece to out. Only the last piece of a stream ends it.
+void deflatePiece(const unsigned char *source, size_t size, bool last, std::vector<unsigned char> & out);
+
+/// Checksum of zlib streams. Checksums of consecutive pieces are combined with adler32Combine().
+unsigned int adler32(const unsigned char *data, size_t size, unsigned int adler = 1);
+unsigned int adler32Combine(unsigned int first, unsigned int second, size_t secondSize);
+
+#endif
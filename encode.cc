@@ -0,0 +1,133 @@
+#include "encode.h"
+#include "qoi.h"
+#include "png-encode.h"
+#include "utils.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+static bool hasExtension(const std::string & filename, const char *extension) {
+	size_t length = strlen(extension);
+
+	return filename.size() >= length && _stricmp(filename.c_str() + filename.size() - length, extension) == 0;
+}
+
+// written under another name first, so nobody sees the file half-written
+static bool writeWholeFile(const std::string & filename, const unsigned char *data, size_t size) {
+	std::string tempname = filename + ".tmp";
+
+	FILE *file = fopen(tempname.c_str(), "wb");
+	if(file == NULL) return false;
+
+	bool ok = fwrite(data, 1, size, file) == size;
+	if(fclose(file) != 0) ok = false;
+
+	if(!ok || !MoveFileExA(tempname.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileA(tempname.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool canEncodeImage(const std::string & filename) {
+	return hasExtension(filename, ".png") || hasExtension(filename, ".qoi");
+}
+
+bool encodeImage(const std::string & filename, const unsigned char *pixels, int w, int h) {
+	if(!canEncodeImage(filename)) {
+		log("can't save %s: only .png and .qoi images can be written\n", filename.c_str());
+		return false;
+	}
+
+	bool ok;
+	if(hasExtension(filename, ".png")) {
+		std::vector<unsigned char> data;
+		pngEncode(pixels, w, h, std::thread::hardware_concurrency(), data);
+		ok = writeWholeFile(filename, data.data(), data.size());
+	} else {
+		size_t size;
+		unsigned char *data = qoiEncode(pixels, w, h, &size);
+		ok = writeWholeFile(filename, data, size);
+		delete[] data;
+	}
+
+	if(!ok) log("couldn't write picture: %s\n", filename.c_str());
+	return ok;
+}
+
+struct EncodeJob {
+	std::string filename;
+	unsigned char *pixels;
+	int width, height;
+};
+
+// shared with the worker and never destroyed, as the detached worker may still be waiting on it when the process exits
+struct EncodeWorker {
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::deque<EncodeJob> jobs;
+
+	bool running;
+	int pending; // queued jobs and the one being written
+
+	EncodeWorker() {
+		running = false;
+		pending = 0;
+	}
+};
+
+static EncodeWorker & worker() {
+	static EncodeWorker *instance = new EncodeWorker;
+	return *instance;
+}
+
+static void encodeWorker() {
+	EncodeWorker & w = worker();
+	std::unique_lock<std::mutex> lock(w.mutex);
+
+	for(;;) {
+		w.jobAvailable.wait(lock, [&w] { return !w.jobs.empty(); });
+
+		EncodeJob job = w.jobs.front();
+		w.jobs.pop_front();
+
+		lock.unlock();
+		encodeImage(job.filename, job.pixels, job.width, job.height);
+		delete[] job.pixels;
+		lock.lock();
+
+		w.pending--;
+	}
+}
+
+void EncodeQueue::push(const std::string & filename, unsigned char *pixels, int w, int h) {
+	EncodeWorker & encoder = worker();
+	std::lock_guard<std::mutex> lock(encoder.mutex);
+
+	EncodeJob job;
+	job.filename = filename;
+	job.pixels = pixels;
+	job.width = w;
+	job.height = h;
+	encoder.jobs.push_back(job);
+	encoder.pending++;
+
+	if(!encoder.running) {
+		encoder.running = true;
+		std::thread(encodeWorker).detach();
+	}
+
+	encoder.jobAvailable.notify_one();
+}
+
+int EncodeQueue::pending() {
+	EncodeWorker & encoder = worker();
+	std::lock_guard<std::mutex> lock(encoder.mutex);
+
+	return encoder.pending;
+}
@@ -0,0 +1,22 @@
+#ifndef __ENCODE_H__
+#define __ENCODE_H__
+
+#include <string>
+
+// Writing 32 bit RGBA pixels, row by row without padding, to image files. The format is picked by the
+// file's extension, .png or .qoi.
+
+bool canEncodeImage(const std::string & filename);
+bool encodeImage(const std::string & filename, const unsigned char *pixels, int w, int h);
+
+// Writes images on a background thread, one at a time in the order they were queued, so the last of
+// several saves to one file wins.
+struct EncodeQueue {
+	/// Takes ownership of pixels, which must have been allocated with new[].
+	static void push(const std::string & filename, unsigned char *pixels, int w, int h);
+
+	/// Number of images queued or being written.
+	static int pending();
+};
+
+#endif
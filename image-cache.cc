@@ -0,0 +1,270 @@
+#include "image-cache.h"
+#include "decode.h"
+#include "xxhash.h"
+#include "utils.h"
+#include "os.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+static const char cacheMagic[4] = { 'I', 'M', 'C', '1' };
+
+// same limit as the decoders
+static const unsigned int maxPixels = 1 << 26;
+
+// a cache file is this header, the key it was stored under, then pixels from the next multiple of 16 bytes
+struct CacheHeader {
+	char magic[4];
+	unsigned int width;
+	unsigned int height;
+	unsigned int keyLength;
+	unsigned long long hash;
+};
+
+static size_t pixelsOffset(size_t keyLength) {
+	return (sizeof(CacheHeader) + keyLength + 15) & ~(size_t) 15;
+}
+
+CachedImage::CachedImage(const std::string & filename, const std::string & key) :file(filename) {
+	pixels = NULL;
+	width = 0;
+	height = 0;
+	hash = 0;
+
+	if(!file.isValid() || file.size < sizeof(CacheHeader)) return;
+
+	CacheHeader header;
+	memcpy(&header, file.view, sizeof(header));
+	if(memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.keyLength != key.size()) return;
+	if(header.width == 0 || header.height == 0 || header.width > maxPixels / header.height) return;
+
+	// the name is a hash of the key, so the key itself tells collisions apart
+	size_t offset = pixelsOffset(key.size());
+	if(file.size != offset + (size_t) header.width * header.height * 4) return;
+	if(memcmp(file.view + sizeof(CacheHeader), key.data(), key.size()) != 0) return;
+
+	pixels = file.view + offset;
+	width = (int) header.width;
+	height = (int) header.height;
+	hash = header.hash;
+}
+
+static std::mutex directoryMutex;
+static std::string cacheDirectory;
+static unsigned long long cacheCapacity = 512ull * 1024 * 1024;
+static unsigned long long cacheBytes = 0; // in the directory, as of the last prune and what was stored since
+
+static unsigned long long fileTime(const FILETIME & time) {
+	return ((unsigned long long) time.dwHighDateTime << 32) | time.dwLowDateTime;
+}
+
+static bool endsWith(const char *s, const char *suffix) {
+	size_t length = strlen(s), suffixLength = strlen(suffix);
+	return length >= suffixLength && _stricmp(s + length - suffixLength, suffix) == 0;
+}
+
+// deletes the files written longest ago until the rest fit in capacity, along with temp files a crash left
+// behind; returns the bytes left. Files in use by this or another game fail to delete and are kept
+static unsigned long long prune(const std::string & directory, unsigned long long capacity) {
+	struct Entry {
+		std::string filename;
+		unsigned long long size;
+		unsigned long long time;
+	};
+
+	std::vector<Entry> entries;
+	unsigned long long total = 0;
+
+	WIN32_FIND_DATAA found;
+	HANDLE handle = FindFirstFileA((directory + "\\*").c_str(), &found);
+	if(handle == INVALID_HANDLE_VALUE) return 0;
+
+	do {
+		if(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+
+		std::string filename = directory + "\\" + found.cFileName;
+		if(endsWith(found.cFileName, ".tmp")) {
+			DeleteFileA(filename.c_str());
+		} else if(endsWith(found.cFileName, ".rgba")) {
+			unsigned long long size = ((unsigned long long) found.nFileSizeHigh << 32) | found.nFileSizeLow;
+			entries.push_back({ filename, size, fileTime(found.ftLastWriteTime) });
+			total += size;
+		}
+	} while(FindNextFileA(handle, &found));
+
+	FindClose(handle);
+
+	std::sort(entries.begin(), entries.end(), [](const Entry & a, const Entry & b) { return a.time < b.time; });
+	for(auto i = entries.begin(); i != entries.end() && total > capacity; ++i) {
+		if(DeleteFileA(i->filename.c_str()))
+			total -= i->size;
+	}
+
+	return total;
+}
+
+// only one thread prunes at a time, the others go on storing meanwhile
+static void pruneDirectory(const std::string & directory) {
+	static std::mutex pruneMutex;
+	std::unique_lock<std::mutex> pruning(pruneMutex, std::try_to_lock);
+	if(!pruning.owns_lock()) return;
+
+	unsigned long long capacity;
+	{
+		std::lock_guard<std::mutex> lock(directoryMutex);
+		capacity = cacheCapacity;
+	}
+
+	unsigned long long bytes = prune(directory, capacity);
+
+	std::lock_guard<std::mutex> lock(directoryMutex);
+	if(directory == cacheDirectory)
+		cacheBytes = bytes;
+}
+
+void ImageCache::setDirectory(const std::string & directory) {
+	if(!directory.empty())
+		OS::mkdir(directory);
+
+	{
+		std::lock_guard<std::mutex> lock(directoryMutex);
+		cacheDirectory = directory;
+		cacheBytes = 0;
+	}
+
+	if(!directory.empty())
+		pruneDirectory(directory);
+}
+
+void ImageCache::setCapacity(int megabytes) {
+	std::string directory;
+	{
+		std::lock_guard<std::mutex> lock(directoryMutex);
+		cacheCapacity = (unsigned long long) (megabytes < 1 ? 1 : megabytes) * 1024 * 1024;
+		directory = cacheDirectory;
+	}
+
+	if(!directory.empty())
+		pruneDirectory(directory);
+}
+
+static std::string currentDirectory() {
+	std::lock_guard<std::mutex> lock(directoryMutex);
+	return cacheDirectory;
+}
+
+// the same file can be named by different relative paths, and the same relative path can name different files
+static std::string fileKey(const std::string & filename) {
+	char fullpath[MAX_PATH];
+	DWORD length = GetFullPathNameA(filename.c_str(), sizeof(fullpath), fullpath, NULL);
+	if(length == 0 || length >= sizeof(fullpath)) return "";
+
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(!GetFileAttributesExA(fullpath, GetFileExInfoStandard, &attributes)) return "";
+
+	unsigned long long size = ((unsigned long long) attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	return format("file:%s:%llu:%llu", fullpath, size, fileTime(attributes.ftLastWriteTime));
+}
+
+// hashing the encoded bytes costs little next to decoding them, and covers blobs from anywhere
+static std::string blobKey(const Blob *blob) {
+	if(blob->data == NULL) return "";
+
+	return format("blob:%d:%016llx", blob->length, XXH64(blob->data, blob->length, 0));
+}
+
+static std::string cacheFilename(const std::string & directory, const std::string & key) {
+	return format("%s\\%016llx.rgba", directory.c_str(), XXH64(key.data(), key.size(), 0));
+}
+
+static bool lookup(const std::string & filename, const std::string & key, unsigned char **pixels, int *w, int *h, unsigned long long *hash, std::shared_ptr<CachedImage> & cached) {
+	std::shared_ptr<CachedImage> image = std::make_shared<CachedImage>(filename, key);
+	if(!image->isValid()) return false;
+
+	cached = image;
+	*pixels = (unsigned char *) image->pixels;
+	*w = image->width;
+	*h = image->height;
+	*hash = image->hash;
+	return true;
+}
+
+// returns the size of the file written, 0 if it wasn't
+static size_t store(const std::string & filename, const std::string & key, const unsigned char *pixels, int w, int h, unsigned long long hash) {
+	// several threads may be storing the same image, each writes its own file
+	std::string tempname = format("%s.%lu.tmp", filename.c_str(), GetCurrentThreadId());
+
+	FILE *file = fopen(tempname.c_str(), "wb");
+	if(file == NULL) return 0;
+
+	size_t size = (size_t) w * h * 4;
+	CacheHeader header;
+	memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.width = w;
+	header.height = h;
+	header.keyLength = (unsigned int) key.size();
+	header.hash = hash;
+
+	static const char zeros[16] = { 0 };
+	size_t padding = pixelsOffset(key.size()) - sizeof(CacheHeader) - key.size();
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(key.data(), 1, key.size(), file) == key.size() &&
+		fwrite(zeros, 1, padding, file) == padding &&
+		fwrite(pixels, 1, size, file) == size;
+
+	if(fclose(file) != 0) ok = false;
+
+	// a half-written file would just fail to load, but there's no reason to leave one around
+	if(!ok || !MoveFileExA(tempname.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileA(tempname.c_str());
+		return 0;
+	}
+
+	return pixelsOffset(key.size()) + size;
+}
+
+// key is empty when the cache is disabled or the source can't be identified
+template<typename Source> static bool decodeThroughCache(const std::string & directory, const std::string & key, const Source & source, unsigned char **pixels, int *w, int *h, unsigned long long *hash, std::shared_ptr<CachedImage> & cached) {
+	std::string filename;
+	if(!key.empty()) {
+		filename = cacheFilename(directory, key);
+		if(lookup(filename, key, pixels, w, h, hash, cached)) return true;
+	}
+
+	*pixels = decodeImage(source, w, h);
+	if(*pixels == NULL) return false;
+
+	*hash = XXH64(*pixels, (size_t) *w * *h * 4, 0);
+	if(filename.empty()) return true;
+
+	size_t size = store(filename, key, *pixels, *w, *h, *hash);
+
+	bool full;
+	{
+		std::lock_guard<std::mutex> lock(directoryMutex);
+		cacheBytes += size;
+		full = cacheBytes > cacheCapacity && directory == cacheDirectory;
+	}
+
+	if(full)
+		pruneDirectory(directory);
+
+	return true;
+}
+
+bool ImageCache::decode(const std::string & filename, unsigned char **pixels, int *w, int *h, unsigned long long *hash, std::shared_ptr<CachedImage> & cached) {
+	std::string directory = currentDirectory();
+	std::string key = directory.empty() ? "" : fileKey(filename);
+
+	return decodeThroughCache(directory, key, filename, pixels, w, h, hash, cached);
+}
+
+bool ImageCache::decode(Blob *blob, unsigned char **pixels, int *w, int *h, unsigned long long *hash, std::shared_ptr<CachedImage> & cached) {
+	std::string directory = currentDirectory();
+	std::string key = directory.empty() ? "" : blobKey(blob);
+
+	return decodeThroughCache(directory, key, blob, pixels, w, h, hash, cached);
+}
@@ -0,0 +1,40 @@
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include <string>
+#include <memory>
+#include "blob.h"
+
+// A decoded image from the cache directory, mapped read-only. Its pixels are valid as long as it exists.
+struct CachedImage {
+	MappedFile file;
+	const unsigned char *pixels;
+	int width, height;
+	unsigned long long hash; // XXH64 of pixels, as Surface computes it
+
+	CachedImage(const std::string & filename, const std::string & key);
+
+	bool isValid() const {
+		return pixels != NULL;
+	}
+};
+
+// Decoded images kept in a directory between launches, so an image seen before is mapped instead of
+// decoded again. Files are identified by full path, size and modification time, blobs by their length and
+// XXH64; a source that changed simply misses. Disabled until a directory is set. Safe to use from any thread.
+//
+// Once the directory holds more than the capacity, the files written longest ago are deleted, which also
+// gets rid of images whose sources changed.
+struct ImageCache {
+	/// Creates the directory if needed; an empty one disables the cache.
+	static void setDirectory(const std::string & directory);
+	static void setCapacity(int megabytes);
+
+	/// Decodes an image like decodeImage(), through the cache. On a hit, cached is set and pixels point into it;
+	/// otherwise pixels are owned by the caller. hash is set to XXH64 of pixels, which surfaces are keyed by.
+	/// Returns false if the image couldn't be decoded.
+	static bool decode(const std::string & filename, unsigned char **pixels, int *w, int *h, unsigned long long *hash, std::shared_ptr<CachedImage> & cached);
+	static bool decode(Blob *blob, unsigned char **pixels, int *w, int *h, unsigned long long *hash, std::shared_ptr<CachedImage> & cached);
+};
+
+#endif
@@ -0,0 +1,311 @@
+#include "inflate.h"
+#include <cstring>
+
+static const int fastBits = 9;
+static const int fastMask = (1 << fastBits) - 1;
+static const int maxBits = 15;
+
+// Canonical Huffman code. Codes of up to fastBits bits are looked up directly by the next input bits;
+// longer ones are found by comparing the bit-reversed input against the last code of each length.
+struct Huffman {
+	unsigned short fast[1 << fastBits]; // (length << 9) | symbol, or 0 for codes longer than fastBits
+	unsigned short firstCode[maxBits + 1];
+	unsigned short firstSymbol[maxBits + 1];
+	unsigned int maxCode[maxBits + 2];  // past the last code of each length, left aligned to 16 bits
+	unsigned short symbols[288];         // sorted by code
+};
+
+static int reverseBits(int value, int bits) {
+	int result = 0;
+	for(int i = 0; i < bits; i++) {
+		result = (result << 1) | (value & 1);
+		value >>= 1;
+	}
+	return result;
+}
+
+static bool buildHuffman(Huffman *h, const unsigned char *lengths, int count) {
+	int sizes[maxBits + 1] = { 0 };
+	int nextCode[maxBits + 1];
+
+	memset(h->fast, 0, sizeof(h->fast));
+	for(int i = 0; i < count; i++)
+		sizes[lengths[i]]++;
+	sizes[0] = 0;
+
+	int code = 0;
+	int symbol = 0;
+	for(int i = 1; i <= maxBits; i++) {
+		nextCode[i] = code;
+		h->firstCode[i] = (unsigned short) code;
+		h->firstSymbol[i] = (unsigned short) symbol;
+
+		code += sizes[i];
+		if(sizes[i] != 0 && code > (1 << i)) return false;
+
+		h->maxCode[i] = code << (16 - i);
+		code <<= 1;
+		symbol += sizes[i];
+	}
+	h->maxCode[maxBits + 1] = 0x10000;
+
+	for(int i = 0; i < count; i++) {
+		int length = lengths[i];
+		if(length == 0) continue;
+
+		int slot = nextCode[length] - h->firstCode[length] + h->firstSymbol[length];
+		h->symbols[slot] = (unsigned short) i;
+
+		if(length <= fastBits) {
+			for(int j = reverseBits(nextCode[length], length); j < (1 << fastBits); j += 1 << length)
+				h->fast[j] = (unsigned short) ((length << 9) | i);
+		}
+
+		nextCode[length]++;
+	}
+
+	return true;
+}
+
+struct BitReader {
+	const unsigned char *in;
+	const unsigned char *end;
+	unsigned long long bits;
+	int count;
+	int overrun; // zero bytes fed past the end of input
+
+	void refill() {
+		while(count <= 56) {
+			unsigned long long byte = 0;
+			if(in < end) byte = *in++;
+			else overrun++;
+
+			bits |= byte << count;
+			count += 8;
+		}
+	}
+
+	unsigned int get(int n) {
+		if(count < n) refill();
+
+		unsigned int value = (unsigned int) (bits & ((1ull << n) - 1));
+		bits >>= n;
+		count -= n;
+		return value;
+	}
+
+	// more than the 8 bytes a refill can read ahead means the stream ended early
+	bool failed() const {
+		return overrun > 8;
+	}
+};
+
+static int decodeSymbol(BitReader & r, const Huffman & h) {
+	if(r.count < 16) r.refill();
+
+	int entry = h.fast[r.bits & fastMask];
+	if(entry != 0) {
+		int length = entry >> 9;
+		r.bits >>= length;
+		r.count -= length;
+		return entry & 511;
+	}
+
+	int k = reverseBits((int) (r.bits & 0xffff), 16);
+	int length = fastBits + 1;
+	while(k >= (int) h.maxCode[length])
+		length++;
+	if(length > maxBits) return -1;
+
+	int slot = (k >> (16 - length)) - h.firstCode[length] + h.firstSymbol[length];
+	if(slot < 0 || slot >= 288) return -1;
+
+	r.bits >>= length;
+	r.count -= length;
+	return h.symbols[slot];
+}
+
+static const unsigned short lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distanceBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distanceExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+struct FixedCodes {
+	Huffman literals;
+	Huffman distances;
+
+	FixedCodes() {
+		unsigned char lengths[288];
+		memset(lengths, 8, 144);
+		memset(lengths + 144, 9, 112);
+		memset(lengths + 256, 7, 24);
+		memset(lengths + 280, 8, 8);
+		buildHuffman(&literals, lengths, 288);
+
+		memset(lengths, 5, 30);
+		buildHuffman(&distances, lengths, 30);
+	}
+};
+
+static bool readDynamicCodes(BitReader & r, Huffman *literals, Huffman *distances) {
+	static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	int literalCount = r.get(5) + 257;
+	int distanceCount = r.get(5) + 1;
+	int codeLengthCount = r.get(4) + 4;
+	if(literalCount > 286 || distanceCount > 30) return false;
+
+	unsigned char codeLengths[19] = { 0 };
+	for(int i = 0; i < codeLengthCount; i++)
+		codeLengths[order[i]] = (unsigned char) r.get(3);
+
+	Huffman codeLengthCode;
+	if(!buildHuffman(&codeLengthCode, codeLengths, 19)) return false;
+
+	// literal and distance lengths are one sequence, repeats may cross from one into the other
+	unsigned char lengths[286 + 30];
+	int total = literalCount + distanceCount;
+	int n = 0;
+	while(n < total) {
+		int symbol = decodeSymbol(r, codeLengthCode);
+		if(symbol < 0) return false;
+
+		if(symbol < 16) {
+			lengths[n++] = (unsigned char) symbol;
+			continue;
+		}
+
+		int repeat;
+		unsigned char value = 0;
+		if(symbol == 16) {
+			if(n == 0) return false;
+			repeat = 3 + r.get(2);
+			value = lengths[n - 1];
+		} else if(symbol == 17) {
+			repeat = 3 + r.get(3);
+		} else {
+			repeat = 11 + r.get(7);
+		}
+
+		if(n + repeat > total) return false;
+		memset(lengths + n, value, repeat);
+		n += repeat;
+	}
+
+	if(lengths[256] == 0) return false;
+
+	return buildHuffman(literals, lengths, literalCount) && buildHuffman(distances, lengths + literalCount, distanceCount);
+}
+
+static bool inflateCompressed(BitReader & r, const Huffman & literals, const Huffman & distances, unsigned char *dest, size_t capacity, size_t & written) {
+	unsigned char *out = dest + written;
+	unsigned char *end = dest + capacity;
+
+	for(;;) {
+		int symbol = decodeSymbol(r, literals);
+		if(symbol < 256) {
+			if(symbol < 0 || out == end) return false;
+			*out++ = (unsigned char) symbol;
+			continue;
+		}
+
+		if(symbol == 256) break;
+
+		symbol -= 257;
+		if(symbol >= 29) return false;
+		int length = lengthBase[symbol] + r.get(lengthExtra[symbol]);
+
+		symbol = decodeSymbol(r, distances);
+		if(symbol < 0 || symbol >= 30) return false;
+		size_t distance = distanceBase[symbol] + r.get(distanceExtra[symbol]);
+
+		if(distance > (size_t) (out - dest) || length > end - out) return false;
+
+		// the source overlaps what is being written when distance < length, so it is copied in pieces
+		// no longer than distance, each of which only reads bytes that are already there
+		const unsigned char *from = out - distance;
+		if(distance == 1) {
+			memset(out, *from, length);
+			out += length;
+		} else if(distance >= 8) {
+			for(; length >= 8; length -= 8, out += 8, from += 8)
+				memcpy(out, from, 8);
+			for(; length > 0; length--)
+				*out++ = *from++;
+		} else {
+			for(; length > 0; length--)
+				*out++ = *from++;
+		}
+	}
+
+	written = out - dest;
+	return !r.failed();
+}
+
+static bool inflateStored(BitReader & r, unsigned char *dest, size_t capacity, size_t & written) {
+	r.get(r.count & 7);
+
+	unsigned int length = r.get(16);
+	unsigned int complement = r.get(16);
+	if((length ^ 0xffff) != complement) return false;
+	if(length > capacity - written) return false;
+
+	// whole bytes still in the bit buffer come first, then the rest straight from input
+	while(length > 0 && r.count >= 8) {
+		dest[written++] = (unsigned char) r.get(8);
+		length--;
+	}
+	if(r.count / 8 < r.overrun) return false;
+
+	if(length > (size_t) (r.end - r.in)) return false;
+	memcpy(dest + written, r.in, length);
+	r.in += length;
+	written += length;
+	return true;
+}
+
+long long zlibDecompress(const unsigned char *source, size_t size, unsigned char *dest, size_t capacity) {
+	static const FixedCodes fixed;
+
+	if(size < 2) return -1;
+
+	int method = source[0];
+	int flags = source[1];
+	if((method & 15) != 8 || (method * 256 + flags) % 31 != 0 || (flags & 32) != 0) return -1;
+
+	BitReader r;
+	r.in = source + 2;
+	r.end = source + size;
+	r.bits = 0;
+	r.count = 0;
+	r.overrun = 0;
+
+	Huffman literals, distances;
+	size_t written = 0;
+	bool final = false;
+	while(!final) {
+		final = r.get(1) != 0;
+		int type = r.get(2);
+
+		bool ok;
+		if(type == 0) {
+			ok = inflateStored(r, dest, capacity, written);
+		} else if(type == 1) {
+			ok = inflateCompressed(r, fixed.literals, fixed.distances, dest, capacity, written);
+		} else if(type == 2) {
+			ok = readDynamicCodes(r, &literals, &distances) && inflateCompressed(r, literals, distances, dest, capacity, written);
+		} else {
+			ok = false;
+		}
+
+		if(!ok || r.failed()) return -1;
+	}
+
+	return (long long) written;
+}
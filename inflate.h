@@ -0,0 +1,12 @@
+#ifndef __INFLATE_H__
+#define __INFLATE_H__
+
+#include <cstddef>
+
+// Decompressor for zlib streams (RFC 1950 wrapping RFC 1951 deflate) into a buffer of known size,
+// which is all PNG needs. The adler32 checksum at the end is not verified.
+
+/// Returns the number of bytes written, or -1 if the input is malformed or the output didn't fit into capacity.
+long long zlibDecompress(const unsigned char *source, size_t size, unsigned char *dest, size_t capacity);
+
+#endif
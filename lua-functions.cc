@@ -3,6 +3,9 @@
 #include "os.h"
 #include <windows.h>
 #include "sdl-utils.h"
+#include "vfs.h"
+#include "dat-hashes.h"
+#include "encode.h"
 #include "LuaBridge/LuaBridge.h"
 
 using namespace luabridge;
@@ -131,6 +134,123 @@ struct SurfaceColorMapped :public SDL::Surface {
 	}
 };
 
+// Points at the Lua string's own bytes instead of copying them. Lua never moves strings, and the
+// reference kept in storage stops this one from being collected while any blob or slice uses it.
+struct BlobFromString :public Blob {
+	BlobFromString(LuaRef r) {
+		source = "string";
+		if(!r.isString()) return;
+
+		lua_State *L = r.state();
+		r.push(L);
+		size_t size = 0;
+		const char *text = lua_tolstring(L, -1, &size);
+		lua_pop(L, 1);
+
+		storage = std::make_shared<LuaRef>(r);
+		data = (unsigned char *) text;
+		length = (int) size;
+	}
+};
+
+namespace stage{
+	SDL::SurfaceStage grayscale() {
+		SDL::SurfaceStage stage;
+		stage.type = SDL::SurfaceStage::GRAYSCALE;
+		return stage;
+	}
+
+	SDL::SurfaceStage multiply(SDL::Color *color) {
+		SDL::SurfaceStage stage;
+		stage.type = SDL::SurfaceStage::MULTIPLY;
+		if(color != NULL) stage.color = *color;
+		return stage;
+	}
+
+	SDL::SurfaceStage colormap(LuaRef r) {
+		SDL::SurfaceStage stage;
+		stage.type = SDL::SurfaceStage::COLORMAP;
+		stage.colormap = std::make_shared<ColorMap>();
+		SDL::colorMapFromColors(*stage.colormap, createColormapFromLua(r));
+		return stage;
+	}
+
+	SDL::SurfaceStage outline(int levels, SDL::Color *color) {
+		SDL::SurfaceStage stage;
+		stage.type = SDL::SurfaceStage::OUTLINE;
+		stage.levels = levels;
+		if(color != NULL) stage.color = *color;
+		return stage;
+	}
+
+	SDL::SurfaceStage outlineRound(int levels, SDL::Color *color) {
+		SDL::SurfaceStage stage = outline(levels, color);
+		stage.outlineStyle = SDL::OUTLINE_ROUND;
+		return stage;
+	}
+}
+
+static std::vector<SDL::SurfaceStage> createStagesFromLua(LuaRef & r) {
+	std::vector<SDL::SurfaceStage> res;
+
+	try {
+		for(int i = 1; i <= r.length(); i++)
+			res.push_back(r[i].cast<SDL::SurfaceStage>());
+	} catch(luabridge::LuaException const& e) {
+		panic(e.what());
+	}
+
+	return res;
+}
+
+struct SurfaceTransformed :public SDL::Surface {
+	SurfaceTransformed(SDL::Surface *parent, LuaRef r) :SDL::Surface(parent, createStagesFromLua(r)) {
+
+	}
+};
+
+struct SurfaceOutlinedRound :public SDL::Surface {
+	SurfaceOutlinedRound(SDL::Surface *parent, int levels, SDL::Color *color) :SDL::Surface(parent, levels, color, SDL::OUTLINE_ROUND) {
+
+	}
+};
+
+struct SurfaceScaledNearest :public SDL::Surface {
+	SurfaceScaledNearest(double scaling, SDL::Surface *parent) :SDL::Surface(parent, scaling, SDL::SCALE_NEAREST) {
+
+	}
+};
+
+struct SurfaceScaledBilinear :public SDL::Surface {
+	SurfaceScaledBilinear(double scaling, SDL::Surface *parent) :SDL::Surface(parent, scaling, SDL::SCALE_BILINEAR) {
+
+	}
+};
+
+struct SurfaceAsync :public SDL::Surface {
+	SurfaceAsync(const std::string & filename) :SDL::Surface(filename, SDL::DECODE_ASYNC) {
+
+	}
+};
+
+struct SurfaceAsyncFromBlob :public SDL::Surface {
+	SurfaceAsyncFromBlob(Blob *blob) :SDL::Surface(blob, SDL::DECODE_ASYNC) {
+
+	}
+};
+
+struct SurfaceView :public SDL::Surface {
+	SurfaceView(SDL::Surface *parent, SDL::Rect *rect) :SDL::Surface(parent, rect) {
+
+	}
+};
+
+struct SurfaceTrimmed :public SDL::Surface {
+	SurfaceTrimmed(SDL::Surface *parent) :SDL::Surface(parent, SDL::SurfaceTransform::TRIM) {
+
+	}
+};
+
 struct SurfaceGrayscale :public SDL::Surface {
 	SurfaceGrayscale(SDL::Surface *parent) :SDL::Surface(parent, SDL::SurfaceTransform::GRAYSCALE) {
 
@@ -163,21 +283,75 @@ void installFunctions(lua_State *L) {
 
 		.beginClass<ResourceDatFile>("resourceDat")
 		.addConstructor <void(*) (const std::string & filename)>()
-		.addFunction("reload", &ResourceDatFile::reload)
+		.addCFunction("reload", &ResourceDatFile::reload)
+		.addCFunction("list", &ResourceDatFile::list)
+		.endClass()
+
+		.deriveClass<MappedResourceDatFile, ResourceDatFile>("mappedResourceDat")
+		.addConstructor <void(*) (const std::string & filename)>()
+		.endClass()
+
+		.beginClass<ResourceDatHashes>("resourceDatHashes")
+		.addConstructor <void(*) (ResourceDatFile *dat)>()
+		.addFunction("update", &ResourceDatHashes::update)
+		.addCFunction("hash", &ResourceDatHashes::hash)
+		.addCFunction("names", &ResourceDatHashes::names)
+		.addCFunction("pixelHash", &ResourceDatHashes::pixelHash)
+		.addCFunction("pixelNames", &ResourceDatHashes::pixelNames)
+		.addCFunction("wasDrawn", &ResourceDatHashes::wasDrawn)
+		.addCFunction("drawn", &ResourceDatHashes::drawn)
+		.endClass()
+
+		.beginClass<ResourceDatWriter>("resourceDatWriter")
+		.addConstructor <void(*) (ResourceDatFile *dat)>()
+		.addData("compress", &ResourceDatWriter::compress)
+		.addFunction("put", &ResourceDatWriter::put)
+		.addCFunction("commit", &ResourceDatWriter::commit)
+		.addCFunction("compact", &ResourceDatWriter::compact)
 		.endClass()
 
 		.beginClass<Blob>("blob")
 		.addData("length", &Blob::length, false)
+		.addFunction("sub", &Blob::sub)
+		.addCFunction("tostring", &Blob::tostring)
+		.addCFunction("u8", &Blob::u8)
+		.addCFunction("u16", &Blob::u16)
+		.addCFunction("u32", &Blob::u32)
+		.addCFunction("f32", &Blob::f32)
+		.endClass()
+
+		.deriveClass<BlobFromString, Blob>("blobFromString")
+		.addConstructor <void(*) (LuaRef r)>()
 		.endClass()
 
 		.deriveClass<BlobFromFile, Blob>("blobFromFile")
 		.addConstructor <void(*) (const std::string & filename)>()
 		.endClass()
 
+		.deriveClass<BlobFromFileStream, Blob>("blobFromFileStream")
+		.addConstructor <void(*) (const std::string & filename)>()
+		.endClass()
+
+		.deriveClass<BlobSlice, Blob>("blobSlice")
+		.addConstructor <void(*) (Blob *parent, int offset, int length)>()
+		.endClass()
+
 		.deriveClass<BlobFromResourceDat, Blob>("blobFromResourceDat")
 		.addConstructor <void(*) (const ResourceDatFile *dat, const std::string & filename)>()
 		.endClass()
 
+		.beginClass<Vfs>("vfs")
+		.addConstructor <void(*) ()>()
+		.addFunction("mountDat", &Vfs::mountDat)
+		.addFunction("mountDir", &Vfs::mountDir)
+		.addFunction("reload", &Vfs::reload)
+		.addFunction("contains", &Vfs::contains)
+		.endClass()
+
+		.deriveClass<BlobFromVfs, Blob>("blobFromVfs")
+		.addConstructor <void(*) (const Vfs *vfs, const std::string & filename)>()
+		.endClass()
+
 		.beginClass <SDL::TextSettings>("textsettings")
 		.addConstructor <void(*) ()>()
 		.addData("antialias", &SDL::TextSettings::antialias)
@@ -195,7 +369,7 @@ void installFunctions(lua_State *L) {
 		.endClass()
 
 		.deriveClass <SDL::FileFont, SDL::Font>("filefontFromBlob")
-		.addConstructor <void(*) (const Blob *blob, double size)>()
+		.addConstructor <void(*) (Blob *blob, double size)>()
 		.endClass()
 
 		.beginClass <SDL::Surface>("surface")
@@ -207,12 +381,26 @@ void installFunctions(lua_State *L) {
 		.addData("x", &SDL::Surface::x, false)
 		.addData("y", &SDL::Surface::y, false)
 		.addFunction("wasDrawn", &SDL::Surface::wasDrawn)
+		.addFunction("isValid", &SDL::Surface::isValid)
+		.addFunction("releasePixels", &SDL::Surface::releasePixels)
+		.addFunction("bounds", &SDL::Surface::bounds)
+		.addFunction("save", &SDL::Surface::save)
+		.addFunction("offsetx", &SDL::Surface::offsetx)
+		.addFunction("offsety", &SDL::Surface::offsety)
 		.endClass()
 
 		.deriveClass<SDL::Surface, SDL::Surface>("surfaceFromBlob")
 		.addConstructor <void(*) (Blob *blob)>()
 		.endClass()
 
+		.deriveClass<SurfaceAsync, SDL::Surface>("surfaceAsync")
+		.addConstructor <void(*) (const std::string & filename)>()
+		.endClass()
+
+		.deriveClass<SurfaceAsyncFromBlob, SDL::Surface>("surfaceAsyncFromBlob")
+		.addConstructor <void(*) (Blob *blob)>()
+		.endClass()
+
 		.deriveClass<SDL::Surface, SDL::Surface>("text")
 		.addConstructor <void(*) (const SDL::Font *, const SDL::TextSettings *settings, const std::string & s)>()
 		.endClass()
@@ -221,10 +409,22 @@ void installFunctions(lua_State *L) {
 		.addConstructor <void(*) (SDL::Surface *base, int levels, SDL::Color *color)>()
 		.endClass()
 
+		.deriveClass<SurfaceOutlinedRound, SDL::Surface>("outlinedRound")
+		.addConstructor <void(*) (SDL::Surface *base, int levels, SDL::Color *color)>()
+		.endClass()
+
 		.deriveClass<SDL::Surface, SDL::Surface>("scaled")
 		.addConstructor <void(*) (int scaling, SDL::Surface *base)>()
 		.endClass()
 
+		.deriveClass<SurfaceScaledNearest, SDL::Surface>("scaledNearest")
+		.addConstructor <void(*) (double scaling, SDL::Surface *base)>()
+		.endClass()
+
+		.deriveClass<SurfaceScaledBilinear, SDL::Surface>("scaledBilinear")
+		.addConstructor <void(*) (double scaling, SDL::Surface *base)>()
+		.endClass()
+
 		.deriveClass<SDL::Surface, SDL::Surface>("multiply")
 		.addConstructor <void(*) (SDL::Surface *base, SDL::Color *color)>()
 		.endClass()
@@ -233,6 +433,29 @@ void installFunctions(lua_State *L) {
 		.addConstructor <void(*) (SDL::Surface *parent, LuaRef r)>()
 		.endClass()
 
+		.deriveClass<SurfaceTransformed, SDL::Surface>("transform")
+		.addConstructor <void(*) (SDL::Surface *base, LuaRef stages)>()
+		.endClass()
+
+		.beginClass<SDL::SurfaceStage>("surfaceStage")
+		.endClass()
+
+		.beginNamespace("stage")
+		.addFunction("grayscale", stage::grayscale)
+		.addFunction("multiply", stage::multiply)
+		.addFunction("colormap", stage::colormap)
+		.addFunction("outline", stage::outline)
+		.addFunction("outlineRound", stage::outlineRound)
+		.endNamespace()
+
+		.deriveClass<SurfaceView, SDL::Surface>("subsurface")
+		.addConstructor <void(*) (SDL::Surface *base, SDL::Rect *rect)>()
+		.endClass()
+
+		.deriveClass<SurfaceTrimmed, SDL::Surface>("trimmed")
+		.addConstructor <void(*) (SDL::Surface *base)>()
+		.endClass()
+
 		.deriveClass<SurfaceGrayscale, SDL::Surface>("grayscale")
 		.addConstructor <void(*) (SDL::Surface *base)>()
 		.endClass()
@@ -311,6 +534,14 @@ void installFunctions(lua_State *L) {
 		.addVariable("textinput", &event::textinput, false)
 		.endNamespace()
 
+		.addCFunction("pixelStats", SDL::PixelStore::stats)
+		.addFunction("decodeWorkers", DecodeQueue::setWorkers)
+		.addFunction("decodeQueueSize", DecodeQueue::setCapacity)
+		.addFunction("imageCache", ImageCache::setDirectory)
+		.addFunction("imageCacheSize", ImageCache::setCapacity)
+		.addFunction("pendingSaves", EncodeQueue::pending)
+		.addFunction("releasePixelsAfterUpload", SDL::PixelStore::setReleaseAfterUpload)
+
 		.beginNamespace("mouse")
 		.addFunction("x", SDL::mousex)
 		.addFunction("y", SDL::mousey)
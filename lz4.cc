@@ -0,0 +1,150 @@
+#include "lz4.h"
+#include <cstring>
+#include <vector>
+
+static const int minMatch = 4;
+static const int lastLiterals = 5;   // the block always ends with at least this many literals
+static const int matchSearchLimit = 12; // no match may start within this many bytes of the end
+static const int hashBits = 12;
+static const int maxOffset = 65535;
+
+static unsigned int read32(const unsigned char *p) {
+	unsigned int value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static unsigned int hashSequence(unsigned int sequence) {
+	return (sequence * 2654435761u) >> (32 - hashBits);
+}
+
+// writes the 255-run continuation of a length that didn't fit into its token nibble
+static unsigned char *writeLength(unsigned char *out, int length) {
+	for(; length >= 255; length -= 255)
+		*out++ = 255;
+	*out++ = (unsigned char) length;
+	return out;
+}
+
+int lz4CompressBound(int size) {
+	return size + size / 255 + 16;
+}
+
+int lz4Compress(const unsigned char *source, int size, unsigned char *dest, int capacity) {
+	if(size < 0) return 0;
+
+	std::vector<int> table(1 << hashBits, -1);
+
+	unsigned char *out = dest;
+	unsigned char *end = dest + capacity;
+	int anchor = 0;
+
+	int position = 0;
+	int limit = size - matchSearchLimit;
+	while(position < limit) {
+		unsigned int sequence = read32(source + position);
+		unsigned int hash = hashSequence(sequence);
+		int candidate = table[hash];
+		table[hash] = position;
+
+		if(candidate < 0 || position - candidate > maxOffset || read32(source + candidate) != sequence) {
+			position++;
+			continue;
+		}
+
+		int matchLength = minMatch;
+		while(position + matchLength < size - lastLiterals && source[candidate + matchLength] == source[position + matchLength])
+			matchLength++;
+
+		int literals = position - anchor;
+		if(end - out < 1 + literals / 255 + 1 + literals + 2 + (matchLength - minMatch) / 255 + 1)
+			return 0;
+
+		unsigned char *token = out++;
+		*token = (unsigned char) ((literals < 15 ? literals : 15) << 4);
+		if(literals >= 15) out = writeLength(out, literals - 15);
+		memcpy(out, source + anchor, literals);
+		out += literals;
+
+		unsigned int offset = position - candidate;
+		*out++ = (unsigned char) (offset & 0xff);
+		*out++ = (unsigned char) (offset >> 8);
+
+		int extra = matchLength - minMatch;
+		*token |= (unsigned char) (extra < 15 ? extra : 15);
+		if(extra >= 15) out = writeLength(out, extra - 15);
+
+		position += matchLength;
+		anchor = position;
+	}
+
+	int literals = size - anchor;
+	if(end - out < 1 + literals / 255 + 1 + literals)
+		return 0;
+
+	*out++ = (unsigned char) ((literals < 15 ? literals : 15) << 4);
+	if(literals >= 15) out = writeLength(out, literals - 15);
+	memcpy(out, source + anchor, literals);
+	out += literals;
+
+	return (int) (out - dest);
+}
+
+int lz4Decompress(const unsigned char *source, int size, unsigned char *dest, int capacity) {
+	const unsigned char *in = source;
+	const unsigned char *inEnd = source + size;
+	unsigned char *out = dest;
+	unsigned char *outEnd = dest + capacity;
+
+	while(in < inEnd) {
+		unsigned char token = *in++;
+
+		size_t literals = token >> 4;
+		if(literals == 15) {
+			unsigned char next;
+			do {
+				if(in >= inEnd) return -1;
+				next = *in++;
+				literals += next;
+			} while(next == 255);
+		}
+
+		if(literals > (size_t) (inEnd - in) || literals > (size_t) (outEnd - out)) return -1;
+		memcpy(out, in, literals);
+		in += literals;
+		out += literals;
+
+		// the last sequence has literals only
+		if(in == inEnd) break;
+
+		if(inEnd - in < 2) return -1;
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		if(offset == 0 || offset > (size_t) (out - dest)) return -1;
+
+		size_t matchLength = token & 15;
+		if(matchLength == 15) {
+			unsigned char next;
+			do {
+				if(in >= inEnd) return -1;
+				next = *in++;
+				matchLength += next;
+			} while(next == 255);
+		}
+		matchLength += minMatch;
+
+		if(matchLength > (size_t) (outEnd - out)) return -1;
+
+		const unsigned char *match = out - offset;
+		if(offset >= matchLength) {
+			memcpy(out, match, matchLength);
+			out += matchLength;
+		} else {
+			// overlapping copy repeats the last offset bytes
+			for(size_t i = 0; i < matchLength; i++)
+				*out++ = match[i];
+		}
+	}
+
+	return (int) (out - dest);
+}
@@ -0,0 +1,16 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+
+// Compressor and decompressor for the LZ4 block format (no frame header, no checksums).
+// Output is readable by any LZ4 implementation's LZ4_decompress_safe.
+
+/// Largest size compressing size bytes can produce.
+int lz4CompressBound(int size);
+
+/// Returns compressed size, or 0 if the output didn't fit into capacity.
+int lz4Compress(const unsigned char *source, int size, unsigned char *dest, int capacity);
+
+/// Returns decompressed size, or -1 if the input is malformed or the output didn't fit into capacity.
+int lz4Decompress(const unsigned char *source, int size, unsigned char *dest, int capacity);
+
+#endif
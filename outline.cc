@@ -0,0 +1,189 @@
+#include "outline.h"
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+// widths up to this are outlined by dilating the whole image once per pixel of width, see tools/outline-bench
+static const int squareScanLevels = 2;
+
+static inline unsigned char alphaAt(const unsigned char *pixels, int index) {
+	return pixels[index * 4 + 3];
+}
+
+static inline void paint(unsigned char *pixels, int index, unsigned int color) {
+	((unsigned int *) pixels)[index] = color;
+}
+
+// One pixel dilation at a time, the way Surface::addOutline always did it. Every pass reads the whole image,
+// but for the one or two passes most outlines need that is faster than keeping lists of pixels to visit.
+static void outlineSquareDilate(unsigned char *pixels, int w, int h, int levels, unsigned int color) {
+	unsigned char *data = new unsigned char[w * h * 4];
+	unsigned char *data2 = new unsigned char[w * h * 4];
+
+	memcpy(data, pixels, 4 * w * h);
+
+	for(int i = 0; i < levels; i++) {
+		memcpy(data2, data, 4 * w * h);
+
+		for(int y = 0; y < h; y++) {
+			for(int x = 0; x < w; x++) {
+				unsigned char *p = &data[(x + y * w) * 4];
+				unsigned char *p2 = &data2[(x + y * w) * 4];
+				if(p[3] > 128) {
+					if(x > 0 && p[-1] < 128)    ((unsigned int *) p2)[-1] = color;
+					if(x + 1 < w && p[7] < 128) ((unsigned int *) p2)[+1] = color;
+				}
+			}
+		}
+
+		memcpy(data, data2, 4 * w * h);
+
+		for(int y = 0; y < h; y++) {
+			for(int x = 0; x < w; x++) {
+				unsigned char *p = &data[(x + y * w) * 4];
+				unsigned char *p2 = &data2[(x + y * w) * 4];
+				if(p[3] > 128) {
+					if(y > 0 && p[-w * 4 + 3] < 128)    ((unsigned int *) p2)[-w] = color;
+					if(y + 1 < h && p[w * 4 + 3] < 128) ((unsigned int *) p2)[+w] = color;
+				}
+			}
+		}
+
+		unsigned char *tmp = data;
+		data = data2;
+		data2 = tmp;
+	}
+
+	memcpy(pixels, data, 4 * w * h);
+
+	delete[] data;
+	delete[] data2;
+}
+
+// Every pass of the old dilation only painted next to pixels that became solid since the previous pass in
+// the same direction, because older ones had already painted all their neighbours. So each pass here
+// starts from just those pixels, and the total work is proportional to the number of painted pixels.
+void outlineSquare(unsigned char *pixels, int w, int h, int levels, unsigned int color) {
+	if(levels <= 0 || w <= 0 || h <= 0) return;
+
+	if(levels <= squareScanLevels) {
+		outlineSquareDilate(pixels, w, h, levels, color);
+		return;
+	}
+
+	std::vector<int> horizontalSources, verticalSources, paintedHorizontal, paintedVertical;
+
+	for(int y = 0; y < h; y++) {
+		for(int x = 0; x < w; x++) {
+			int i = x + y * w;
+			if(alphaAt(pixels, i) <= 128) continue;
+
+			if((x > 0 && alphaAt(pixels, i - 1) < 128) || (x + 1 < w && alphaAt(pixels, i + 1) < 128))
+				horizontalSources.push_back(i);
+			if((y > 0 && alphaAt(pixels, i - w) < 128) || (y + 1 < h && alphaAt(pixels, i + w) < 128))
+				verticalSources.push_back(i);
+		}
+	}
+
+	// a pixel painted during a pass already has full alpha, so it is neither painted twice
+	// nor does it count as a source until the next pass
+	for(int level = 0; level < levels; level++) {
+		paintedHorizontal.clear();
+		for(int i : horizontalSources) {
+			int x = i % w;
+			if(x > 0 && alphaAt(pixels, i - 1) < 128) {
+				paint(pixels, i - 1, color);
+				paintedHorizontal.push_back(i - 1);
+			}
+			if(x + 1 < w && alphaAt(pixels, i + 1) < 128) {
+				paint(pixels, i + 1, color);
+				paintedHorizontal.push_back(i + 1);
+			}
+		}
+
+		verticalSources.insert(verticalSources.end(), paintedHorizontal.begin(), paintedHorizontal.end());
+
+		paintedVertical.clear();
+		for(int i : verticalSources) {
+			if(i >= w && alphaAt(pixels, i - w) < 128) {
+				paint(pixels, i - w, color);
+				paintedVertical.push_back(i - w);
+			}
+			if(i + w < w * h && alphaAt(pixels, i + w) < 128) {
+				paint(pixels, i + w, color);
+				paintedVertical.push_back(i + w);
+			}
+		}
+
+		if(paintedHorizontal.empty() && paintedVertical.empty())
+			break;
+
+		horizontalSources.swap(paintedHorizontal);
+		horizontalSources.insert(horizontalSources.end(), paintedVertical.begin(), paintedVertical.end());
+		verticalSources.swap(paintedVertical);
+	}
+}
+
+// stands in for "no solid pixel on this line"; small enough that differences of it stay exact
+static const double far = 1e12;
+
+static inline double intersection(const std::vector<double> & f, int q, int p) {
+	return ((f[q] + (double) q * q) - (f[p] + (double) p * p)) / (2.0 * (q - p));
+}
+
+// squared distance to the nearest zero along one line, via the lower envelope of parabolas
+// (Felzenszwalb & Huttenlocher), reading and writing every step-th element of values
+static void distanceLine(double *values, int n, int step, std::vector<double> & f, std::vector<int> & v, std::vector<double> & z) {
+	for(int q = 0; q < n; q++)
+		f[q] = values[q * step];
+
+	int k = 0;
+	v[0] = 0;
+	z[0] = -HUGE_VAL;
+	z[1] = HUGE_VAL;
+
+	for(int q = 1; q < n; q++) {
+		double s = intersection(f, q, v[k]);
+		while(s <= z[k]) {
+			k--;
+			s = intersection(f, q, v[k]);
+		}
+
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = HUGE_VAL;
+	}
+
+	k = 0;
+	for(int q = 0; q < n; q++) {
+		while(z[k + 1] < q) k++;
+		double d = q - v[k];
+		values[q * step] = d * d + f[v[k]];
+	}
+}
+
+void outlineRound(unsigned char *pixels, int w, int h, int levels, unsigned int color) {
+	if(levels <= 0 || w <= 0 || h <= 0) return;
+
+	std::vector<double> distance(w * h);
+	for(int i = 0; i < w * h; i++)
+		distance[i] = alphaAt(pixels, i) > 128 ? 0 : far;
+
+	int longest = w > h ? w : h;
+	std::vector<double> f(longest);
+	std::vector<int> v(longest);
+	std::vector<double> z(longest + 1);
+
+	for(int x = 0; x < w; x++)
+		distanceLine(distance.data() + x, h, w, f, v, z);
+	for(int y = 0; y < h; y++)
+		distanceLine(distance.data() + y * w, w, 1, f, v, z);
+
+	// (levels + 0.5) squared, as distances between pixel centers are square roots of integers
+	double limit = (double) levels * levels + levels;
+	for(int i = 0; i < w * h; i++) {
+		if(distance[i] <= limit && alphaAt(pixels, i) < 128)
+			paint(pixels, i, color);
+	}
+}
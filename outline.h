@@ -0,0 +1,14 @@
+#ifndef __OUTLINE_H__
+#define __OUTLINE_H__
+
+// Outlines paint pixels with alpha below 128 that are within the given distance of a pixel with alpha
+// above 128. Past a width of 2 both run in time proportional to the image size, whatever the width.
+
+/// Square outline: what repeating a horizontal then a vertical one pixel dilation levels times produces,
+/// including pixels with alpha of exactly 128 acting as walls the outline has to go around.
+void outlineSquare(unsigned char *pixels, int w, int h, int levels, unsigned int color);
+
+/// Round outline: pixels within euclidean distance levels (plus half a pixel) of the shape.
+void outlineRound(unsigned char *pixels, int w, int h, int levels, unsigned int color);
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef __PATH_INDEX_H__
+#define __PATH_INDEX_H__
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+// Open-addressing hash table keyed by asset paths. Names are stored once in a contiguous
+// string pool; keys are normalized so lookups ignore ASCII case and treat '\' as '/'.
+template<typename T>
+struct PathIndex {
+	struct Entry {
+		unsigned int nameOffset;
+		unsigned int nameLength;
+		unsigned int hash;
+		T value;
+	};
+
+	std::vector<char> pool;
+	std::vector<Entry> entries;
+
+	PathIndex() {
+		mask = 0;
+		sortedValid = false;
+	}
+
+	static char normalize(char c) {
+		if(c == '\\') return '/';
+		if(c >= 'A' && c <= 'Z') return c - 'A' + 'a';
+		return c;
+	}
+
+	static unsigned int hashName(const char *name, size_t length) {
+		unsigned int hash = 2166136261u;
+		for(size_t i = 0; i < length; i++) {
+			hash ^= (unsigned char) normalize(name[i]);
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	void clear() {
+		pool.clear();
+		entries.clear();
+		slots.clear();
+		mask = 0;
+		sortedValid = false;
+	}
+
+	void reserve(size_t count, size_t poolSize) {
+		entries.reserve(count);
+		pool.reserve(poolSize);
+		if(count * 2 > slots.size())
+			rehash(count * 2);
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+
+	bool empty() const {
+		return entries.empty();
+	}
+
+	std::string name(const Entry &entry) const {
+		return std::string(pool.data() + entry.nameOffset, entry.nameLength);
+	}
+
+	const Entry *findEntry(const char *name, size_t length) const {
+		if(slots.empty()) return NULL;
+
+		unsigned int hash = hashName(name, length);
+		for(size_t slot = hash & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+			const Entry &entry = entries[slots[slot] - 1];
+			if(entry.hash == hash && matches(entry, name, length))
+				return &entry;
+		}
+		return NULL;
+	}
+
+	const T *find(const char *name, size_t length) const {
+		const Entry *entry = findEntry(name, length);
+		return entry == NULL ? NULL : &entry->value;
+	}
+
+	T *find(const char *name, size_t length) {
+		const Entry *entry = findEntry(name, length);
+		return entry == NULL ? NULL : const_cast<T *>(&entry->value);
+	}
+
+	const T *find(const std::string &name) const {
+		return find(name.data(), name.size());
+	}
+
+	T *find(const std::string &name) {
+		return find(name.data(), name.size());
+	}
+
+	// inserts a new entry, or replaces the value of an existing entry with the same key
+	T &insert(const char *name, size_t length, const T &value) {
+		if((entries.size() + 1) * 2 > slots.size())
+			rehash(slots.empty() ? 16 : slots.size() * 2);
+
+		unsigned int hash = hashName(name, length);
+		size_t slot = hash & mask;
+		for(; slots[slot] != 0; slot = (slot + 1) & mask) {
+			Entry &entry = entries[slots[slot] - 1];
+			if(entry.hash == hash && matches(entry, name, length)) {
+				entry.value = value;
+				return entry.value;
+			}
+		}
+
+		Entry entry;
+		entry.nameOffset = (unsigned int) pool.size();
+		entry.nameLength = (unsigned int) length;
+		entry.hash = hash;
+		entry.value = value;
+		pool.insert(pool.end(), name, name + length);
+
+		entries.push_back(entry);
+		slots[slot] = (unsigned int) entries.size();
+		sortedValid = false;
+
+		return entries.back().value;
+	}
+
+	T &insert(const std::string &name, const T &value) {
+		return insert(name.data(), name.size(), value);
+	}
+
+	// the removed name stays in the string pool until the index is cleared
+	bool remove(const char *name, size_t length) {
+		if(slots.empty()) return false;
+
+		unsigned int hash = hashName(name, length);
+		size_t slot = hash & mask;
+		for(; slots[slot] != 0; slot = (slot + 1) & mask) {
+			const Entry &entry = entries[slots[slot] - 1];
+			if(entry.hash == hash && matches(entry, name, length))
+				break;
+		}
+		if(slots[slot] == 0) return false;
+
+		unsigned int removed = slots[slot] - 1;
+		unsigned int last = (unsigned int) entries.size() - 1;
+
+		// backward-shift deletion keeps probe sequences intact without tombstones
+		size_t hole = slot;
+		for(size_t next = (hole + 1) & mask; slots[next] != 0; next = (next + 1) & mask) {
+			size_t home = entries[slots[next] - 1].hash & mask;
+			if(((next - home) & mask) >= ((next - hole) & mask)) {
+				slots[hole] = slots[next];
+				hole = next;
+			}
+		}
+		slots[hole] = 0;
+
+		if(removed != last) {
+			entries[removed] = entries[last];
+			slots[slotOf(last)] = removed + 1;
+		}
+		entries.pop_back();
+		sortedValid = false;
+
+		return true;
+	}
+
+	bool remove(const std::string &name) {
+		return remove(name.data(), name.size());
+	}
+
+	// calls func for every entry whose normalized name starts with the normalized prefix, in sorted order
+	template<typename F>
+	void forEachWithPrefix(const std::string &prefix, F func) const {
+		const std::vector<unsigned int> &order = sorted();
+
+		auto less = [&](unsigned int index, const std::string &key) {
+			const Entry &entry = entries[index];
+			size_t length = entry.nameLength < key.size() ? entry.nameLength : key.size();
+			int result = compare(pool.data() + entry.nameOffset, key.data(), length);
+			return result < 0 || (result == 0 && entry.nameLength < key.size());
+		};
+
+		for(auto i = std::lower_bound(order.begin(), order.end(), prefix, less); i != order.end(); ++i) {
+			const Entry &entry = entries[*i];
+			if(entry.nameLength < prefix.size() || compare(pool.data() + entry.nameOffset, prefix.data(), prefix.size()) != 0)
+				break;
+
+			func(entry);
+		}
+	}
+
+private:
+	std::vector<unsigned int> slots; // entry index + 1, 0 marks an empty slot
+	size_t mask;
+
+	// entry indices ordered by normalized name, built on first use after the index changes
+	mutable std::vector<unsigned int> sortedEntries;
+	mutable bool sortedValid;
+
+	static int compare(const char *a, const char *b, size_t length) {
+		for(size_t i = 0; i < length; i++) {
+			unsigned char ca = normalize(a[i]), cb = normalize(b[i]);
+			if(ca != cb) return ca < cb ? -1 : 1;
+		}
+		return 0;
+	}
+
+	const std::vector<unsigned int> &sorted() const {
+		if(sortedValid) return sortedEntries;
+
+		sortedEntries.resize(entries.size());
+		for(size_t i = 0; i < entries.size(); i++)
+			sortedEntries[i] = (unsigned int) i;
+
+		std::sort(sortedEntries.begin(), sortedEntries.end(), [&](unsigned int a, unsigned int b) {
+			const Entry &ea = entries[a], &eb = entries[b];
+			size_t length = ea.nameLength < eb.nameLength ? ea.nameLength : eb.nameLength;
+			int result = compare(pool.data() + ea.nameOffset, pool.data() + eb.nameOffset, length);
+			return result < 0 || (result == 0 && ea.nameLength < eb.nameLength);
+		});
+
+		sortedValid = true;
+		return sortedEntries;
+	}
+
+	bool matches(const Entry &entry, const char *name, size_t length) const {
+		if(entry.nameLength != length) return false;
+
+		const char *stored = pool.data() + entry.nameOffset;
+		for(size_t i = 0; i < length; i++) {
+			if(normalize(stored[i]) != normalize(name[i]))
+				return false;
+		}
+		return true;
+	}
+
+	size_t slotOf(unsigned int entryIndex) const {
+		size_t slot = entries[entryIndex].hash & mask;
+		while(slots[slot] != entryIndex + 1)
+			slot = (slot + 1) & mask;
+		return slot;
+	}
+
+	void rehash(size_t minimum) {
+		size_t capacity = 16;
+		while(capacity < minimum) capacity *= 2;
+
+		slots.assign(capacity, 0);
+		mask = capacity - 1;
+
+		for(size_t i = 0; i < entries.size(); i++) {
+			size_t slot = entries[i].hash & mask;
+			while(slots[slot] != 0)
+				slot = (slot + 1) & mask;
+			slots[slot] = (unsigned int) i + 1;
+		}
+	}
+};
+
+#endif
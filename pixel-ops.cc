@@ -0,0 +1,23 @@
+#include "pixel-ops.h"
+
+void grayscalePixels(const unsigned int *src, unsigned int *dst, int count) {
+	for(int i = 0; i < count; i++) {
+		unsigned int pixel = src[i];
+		unsigned int r = pixel & 0x000000ff;
+		unsigned int g = (pixel >> 8) & 0x000000ff;
+		unsigned int b = (pixel >> 16) & 0x000000ff;
+		unsigned int gray = (21 * r + 72 * g + 7 * b) / 100;
+		dst[i] = (pixel & 0xff000000) | gray | (gray << 8) | (gray << 16);
+	}
+}
+
+void multiplyPixels(const unsigned int *src, unsigned int *dst, int count, unsigned int r, unsigned int g, unsigned int b, unsigned int a) {
+	for(int i = 0; i < count; i++) {
+		unsigned int pixel = src[i];
+		unsigned int pr = ((pixel & 0x000000ff) * r / 0xff) & 0x000000ff;
+		unsigned int pg = ((pixel & 0x0000ff00) * g / 0xff) & 0x0000ff00;
+		unsigned int pb = ((pixel & 0x00ff0000) * b / 0xff) & 0x00ff0000;
+		unsigned int pa = (((pixel >> 24) & 0x000000ff) * a / 0xff) << 24;
+		dst[i] = pa | pr | pg | pb;
+	}
+}
@@ -0,0 +1,11 @@
+#ifndef __PIXEL_OPS_H__
+#define __PIXEL_OPS_H__
+
+// Per-pixel operations on runs of 32 bit RGBA pixels. src and dst may be the same buffer.
+
+void grayscalePixels(const unsigned int *src, unsigned int *dst, int count);
+
+/// Scales every channel by the matching channel of (r, g, b, a) / 255.
+void multiplyPixels(const unsigned int *src, unsigned int *dst, int count, unsigned int r, unsigned int g, unsigned int b, unsigned int a);
+
+#endif
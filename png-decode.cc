@@ -0,0 +1,420 @@
+#include "png-decode.h"
+#include "inflate.h"
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PNG_SSE2
+#include <emmintrin.h>
+#endif
+
+static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+// no image the game or mods use comes anywhere near this, it only guards against absurd headers
+static const unsigned int maxPixels = 1 << 26;
+
+enum ColorType { GRAY = 0, RGB = 2, PALETTE = 3, GRAY_ALPHA = 4, RGBA = 6 };
+
+struct PngHeader {
+	unsigned int width, height;
+	int depth;
+	int colorType;
+	int interlace;
+
+	int channels;
+	int bytesPerPixel; // distance to the byte the sub, average and paeth filters predict from, at least 1
+
+	size_t rowBytes(unsigned int w) const {
+		return ((size_t) w * channels * depth + 7) / 8;
+	}
+};
+
+static unsigned int read32(const unsigned char *p) {
+	return ((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) | ((unsigned int) p[2] << 8) | p[3];
+}
+
+bool pngSignature(const unsigned char *data, size_t size) {
+	return size >= 8 && memcmp(data, signature, 8) == 0;
+}
+
+static bool readHeader(const unsigned char *p, unsigned int length, PngHeader & h) {
+	if(length != 13) return false;
+
+	h.width = read32(p);
+	h.height = read32(p + 4);
+	h.depth = p[8];
+	h.colorType = p[9];
+	h.interlace = p[12];
+	if(p[10] != 0 || p[11] != 0 || h.interlace > 1) return false;
+	if(h.width == 0 || h.height == 0 || h.width > maxPixels / h.height) return false;
+
+	// how GDI+ reduces 16 bit samples to 8 isn't documented, so those images are left to it
+	int d = h.depth;
+	switch(h.colorType) {
+	case GRAY:       h.channels = 1; if(d != 1 && d != 2 && d != 4 && d != 8) return false; break;
+	case PALETTE:    h.channels = 1; if(d != 1 && d != 2 && d != 4 && d != 8) return false; break;
+	case RGB:        h.channels = 3; if(d != 8) return false; break;
+	case GRAY_ALPHA: h.channels = 2; if(d != 8) return false; break;
+	case RGBA:       h.channels = 4; if(d != 8) return false; break;
+	default: return false;
+	}
+
+	h.bytesPerPixel = (h.channels * h.depth + 7) / 8;
+	return true;
+}
+
+static inline unsigned char paethPredictor(int a, int b, int c) {
+	int pa = b - c;
+	int pb = a - c;
+	int pc = pa + pb;
+	if(pa < 0) pa = -pa;
+	if(pb < 0) pb = -pb;
+	if(pc < 0) pc = -pc;
+
+	if(pa <= pb && pa <= pc) return (unsigned char) a;
+	if(pb <= pc) return (unsigned char) b;
+	return (unsigned char) c;
+}
+
+static void unfilterScalar(int filter, unsigned char *row, const unsigned char *prior, size_t length, int bpp, size_t start) {
+	size_t i = start;
+	switch(filter) {
+	case 1:
+		for(; i < length; i++) row[i] = (unsigned char) (row[i] + (i >= (size_t) bpp ? row[i - bpp] : 0));
+		break;
+	case 2:
+		for(; i < length; i++) row[i] = (unsigned char) (row[i] + prior[i]);
+		break;
+	case 3:
+		for(; i < length; i++) row[i] = (unsigned char) (row[i] + (((i >= (size_t) bpp ? row[i - bpp] : 0) + prior[i]) >> 1));
+		break;
+	case 4:
+		for(; i < length; i++) {
+			if(i < (size_t) bpp) row[i] = (unsigned char) (row[i] + prior[i]);
+			else row[i] = (unsigned char) (row[i] + paethPredictor(row[i - bpp], prior[i], prior[i - bpp]));
+		}
+		break;
+	}
+}
+
+#ifdef PNG_SSE2
+
+static inline __m128i load3(const unsigned char *p) {
+	int value = 0;
+	memcpy(&value, p, 3);
+	return _mm_cvtsi32_si128(value);
+}
+
+static inline void store3(unsigned char *p, __m128i v) {
+	int value = _mm_cvtsi128_si32(v);
+	memcpy(p, &value, 3);
+}
+
+static inline __m128i load4(const unsigned char *p) {
+	int value;
+	memcpy(&value, p, 4);
+	return _mm_cvtsi32_si128(value);
+}
+
+static inline void store4(unsigned char *p, __m128i v) {
+	int value = _mm_cvtsi128_si32(v);
+	memcpy(p, &value, 4);
+}
+
+static inline __m128i abs16(__m128i v) {
+	return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+static inline __m128i blend(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// The sub, average and paeth filters depend on the pixel just decoded, so 3 and 4 byte pixels are done one
+// at a time with all their channels in one register; up has no such dependency and goes 16 bytes at a time.
+template<int bpp>
+static void unfilterPixels(int filter, unsigned char *row, const unsigned char *prior, size_t length) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = zero; // reconstructed pixel to the left
+	__m128i c = zero; // pixel above that
+	size_t i = 0;
+
+	switch(filter) {
+	case 1:
+		for(; i + bpp <= length; i += bpp) {
+			__m128i x = bpp == 4 ? load4(row + i) : load3(row + i);
+			a = _mm_add_epi8(x, a);
+			if(bpp == 4) store4(row + i, a); else store3(row + i, a);
+		}
+		break;
+	case 3:
+		for(; i + bpp <= length; i += bpp) {
+			__m128i b = bpp == 4 ? load4(prior + i) : load3(prior + i);
+			__m128i x = bpp == 4 ? load4(row + i) : load3(row + i);
+			// average rounding down, where _mm_avg_epu8 rounds up
+			__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+			a = _mm_add_epi8(x, average);
+			if(bpp == 4) store4(row + i, a); else store3(row + i, a);
+		}
+		break;
+	case 4:
+		for(; i + bpp <= length; i += bpp) {
+			__m128i b = _mm_unpacklo_epi8(bpp == 4 ? load4(prior + i) : load3(prior + i), zero);
+			__m128i x = _mm_unpacklo_epi8(bpp == 4 ? load4(row + i) : load3(row + i), zero);
+
+			__m128i pa = _mm_sub_epi16(b, c);
+			__m128i pb = _mm_sub_epi16(a, c);
+			__m128i pc = abs16(_mm_add_epi16(pa, pb));
+			pa = abs16(pa);
+			pb = abs16(pb);
+
+			__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+			__m128i predicted = blend(_mm_cmpeq_epi16(pa, smallest), a,
+				blend(_mm_cmpeq_epi16(pb, smallest), b, c));
+
+			a = _mm_add_epi8(x, predicted);
+			a = _mm_and_si128(a, _mm_set1_epi16(0xff));
+			c = b;
+			if(bpp == 4) store4(row + i, _mm_packus_epi16(a, a)); else store3(row + i, _mm_packus_epi16(a, a));
+		}
+		break;
+	}
+}
+
+static void unfilterUp(unsigned char *row, const unsigned char *prior, size_t length) {
+	size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (row + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (prior + i));
+		_mm_storeu_si128((__m128i *) (row + i), _mm_add_epi8(x, b));
+	}
+	unfilterScalar(2, row, prior, length, 1, i);
+}
+
+#endif
+
+// prior is the previous row after unfiltering, or zeros for the first row of an image or interlace pass
+static bool unfilterRow(int filter, unsigned char *row, const unsigned char *prior, size_t length, int bpp) {
+	if(filter > 4) return false;
+	if(filter == 0) return true;
+
+#ifdef PNG_SSE2
+	if(filter == 2) {
+		unfilterUp(row, prior, length);
+		return true;
+	}
+	if(bpp == 4) {
+		unfilterPixels<4>(filter, row, prior, length);
+		return true;
+	}
+	if(bpp == 3) {
+		unfilterPixels<3>(filter, row, prior, length);
+		return true;
+	}
+#endif
+
+	unfilterScalar(filter, row, prior, length, bpp, 0);
+	return true;
+}
+
+struct Transparency {
+	unsigned int palette[256]; // RGBA as it is laid out in memory, little endian
+	bool hasKey;
+	unsigned short key[3];     // color that is fully transparent, for gray and RGB images
+};
+
+static inline unsigned int pack(unsigned int r, unsigned int g, unsigned int b, unsigned int a) {
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static inline unsigned int read16(const unsigned char *p) {
+	return (p[0] << 8) | p[1];
+}
+
+// expands one unfiltered row of w pixels to RGBA
+static void convertRow(const PngHeader & h, const Transparency & t, const unsigned char *in, unsigned int *out, unsigned int w) {
+	unsigned int x;
+
+	switch(h.colorType) {
+	case RGBA:
+		memcpy(out, in, w * 4);
+		break;
+
+	case RGB:
+		for(x = 0; x < w; x++, in += 3) {
+			bool clear = t.hasKey && in[0] == t.key[0] && in[1] == t.key[1] && in[2] == t.key[2];
+			out[x] = pack(in[0], in[1], in[2], clear ? 0 : 255);
+		}
+		break;
+
+	case GRAY_ALPHA:
+		for(x = 0; x < w; x++, in += 2)
+			out[x] = pack(in[0], in[0], in[0], in[1]);
+		break;
+
+	case PALETTE:
+		if(h.depth == 8) {
+			for(x = 0; x < w; x++)
+				out[x] = t.palette[in[x]];
+			break;
+		}
+		// low bit depth palette indices are unpacked the same way gray values are
+		// fall through
+	case GRAY: {
+		int depth = h.depth;
+		int perByte = 8 / depth;
+		unsigned int mask = (1 << depth) - 1;
+		unsigned int scale = 255 / mask;
+		for(x = 0; x < w; x++) {
+			unsigned int value = (in[x / perByte] >> (8 - depth - (x % perByte) * depth)) & mask;
+			if(h.colorType == PALETTE) {
+				out[x] = t.palette[value];
+			} else {
+				unsigned int gray = value * scale;
+				bool clear = t.hasKey && value == t.key[0];
+				out[x] = pack(gray, gray, gray, clear ? 0 : 255);
+			}
+		}
+		break;
+	}
+	}
+}
+
+// pass origins and steps of Adam7 interlacing; non-interlaced images are a single pass of step 1
+static const int passes[7][4] = {
+	{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+
+static unsigned int passSize(unsigned int size, int origin, int step) {
+	return size > (unsigned int) origin ? (size - origin + step - 1) / step : 0;
+}
+
+unsigned char *pngDecode(const unsigned char *data, size_t size, int *w, int *h) {
+	if(!pngSignature(data, size)) return NULL;
+
+	PngHeader header;
+	bool haveHeader = false;
+	Transparency t;
+	t.hasKey = false;
+	for(int i = 0; i < 256; i++)
+		t.palette[i] = pack(0, 0, 0, 255);
+
+	// IDAT chunks are usually one, and only copied into a single stream when there are more
+	const unsigned char *idat = NULL;
+	size_t idatSize = 0;
+	std::vector<unsigned char> joined;
+
+	size_t pos = 8;
+	for(;;) {
+		if(size - pos < 12) return NULL;
+
+		unsigned int length = read32(data + pos);
+		const unsigned char *type = data + pos + 4;
+		const unsigned char *chunk = data + pos + 8;
+		if(length > size - pos - 12) return NULL;
+		pos += 12 + length;
+
+		if(memcmp(type, "IHDR", 4) == 0) {
+			if(!readHeader(chunk, length, header)) return NULL;
+			haveHeader = true;
+		} else if(!haveHeader) {
+			return NULL;
+		} else if(memcmp(type, "PLTE", 4) == 0) {
+			if(length % 3 != 0 || length > 768) return NULL;
+			for(unsigned int i = 0; i < length / 3; i++)
+				t.palette[i] = pack(chunk[i * 3], chunk[i * 3 + 1], chunk[i * 3 + 2], t.palette[i] >> 24);
+		} else if(memcmp(type, "tRNS", 4) == 0) {
+			if(header.colorType == PALETTE) {
+				if(length > 256) return NULL;
+				for(unsigned int i = 0; i < length; i++)
+					t.palette[i] = (t.palette[i] & 0x00ffffff) | ((unsigned int) chunk[i] << 24);
+			} else if(header.colorType == GRAY && length == 2) {
+				t.hasKey = true;
+				t.key[0] = (unsigned short) read16(chunk);
+			} else if(header.colorType == RGB && length == 6) {
+				t.hasKey = true;
+				t.key[0] = (unsigned short) read16(chunk);
+				t.key[1] = (unsigned short) read16(chunk + 2);
+				t.key[2] = (unsigned short) read16(chunk + 4);
+			}
+		} else if(memcmp(type, "gAMA", 4) == 0) {
+			// GDI+ corrects gamma other than the usual 1/2.2; leave those to it
+			if(length != 4 || read32(chunk) != 45455) return NULL;
+		} else if(memcmp(type, "iCCP", 4) == 0) {
+			return NULL;
+		} else if(memcmp(type, "IDAT", 4) == 0) {
+			if(idat == NULL) {
+				idat = chunk;
+				idatSize = length;
+			} else {
+				if(joined.empty()) joined.assign(idat, idat + idatSize);
+				joined.insert(joined.end(), chunk, chunk + length);
+			}
+		} else if(memcmp(type, "IEND", 4) == 0) {
+			break;
+		}
+	}
+
+	if(idat == NULL) return NULL;
+	if(!joined.empty()) {
+		idat = joined.data();
+		idatSize = joined.size();
+	}
+
+	int passCount = header.interlace ? 7 : 1;
+	size_t rawSize = 0;
+	for(int p = 0; p < passCount; p++) {
+		unsigned int pw = header.interlace ? passSize(header.width, passes[p][0], passes[p][2]) : header.width;
+		unsigned int ph = header.interlace ? passSize(header.height, passes[p][1], passes[p][3]) : header.height;
+		if(pw != 0 && ph != 0)
+			rawSize += (header.rowBytes(pw) + 1) * ph;
+	}
+
+	std::vector<unsigned char> raw(rawSize);
+	if(zlibDecompress(idat, idatSize, raw.data(), rawSize) != (long long) rawSize) return NULL;
+
+	unsigned int width = header.width;
+	unsigned int height = header.height;
+	unsigned int *pixels = new unsigned int[(size_t) width * height];
+
+	std::vector<unsigned char> zeros(header.rowBytes(width));
+	std::vector<unsigned int> passRow(header.interlace ? width : 0);
+
+	unsigned char *row = raw.data();
+	for(int p = 0; p < passCount; p++) {
+		int x0 = 0, y0 = 0, dx = 1, dy = 1;
+		if(header.interlace) {
+			x0 = passes[p][0];
+			y0 = passes[p][1];
+			dx = passes[p][2];
+			dy = passes[p][3];
+		}
+
+		unsigned int pw = passSize(width, x0, dx);
+		unsigned int ph = passSize(height, y0, dy);
+		if(pw == 0 || ph == 0) continue;
+
+		size_t length = header.rowBytes(pw);
+		const unsigned char *prior = zeros.data();
+		for(unsigned int y = 0; y < ph; y++) {
+			if(!unfilterRow(row[0], row + 1, prior, length, header.bytesPerPixel)) {
+				delete[] pixels;
+				return NULL;
+			}
+
+			unsigned int *out = pixels + (size_t) (y0 + y * dy) * width;
+			if(header.interlace) {
+				convertRow(header, t, row + 1, passRow.data(), pw);
+				for(unsigned int x = 0; x < pw; x++)
+					out[x0 + x * dx] = passRow[x];
+			} else {
+				convertRow(header, t, row + 1, out, pw);
+			}
+
+			prior = row + 1;
+			row += length + 1;
+		}
+	}
+
+	*w = (int) width;
+	*h = (int) height;
+	return (unsigned char *) pixels;
+}
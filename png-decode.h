@@ -0,0 +1,15 @@
+#ifndef __PNG_DECODE_H__
+#define __PNG_DECODE_H__
+
+#include <cstddef>
+
+// PNG decoder without dependencies on Windows or other libraries. Supports every color type, bit depths up
+// to 8 and interlacing. 16 bit images and ones whose colors GDI+ would gamma correct or color manage are
+// refused, so callers can fall back to it and get the same pixels either way.
+
+bool pngSignature(const unsigned char *data, size_t size);
+
+/// Returns 32 bit RGBA pixels in an array the caller owns, or NULL if the image is malformed or refused.
+unsigned char *pngDecode(const unsigned char *data, size_t size, int *w, int *h);
+
+#endif
@@ -0,0 +1,282 @@
+#include "png-encode.h"
+#include "deflate.h"
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PNG_SSE2
+#include <emmintrin.h>
+#endif
+
+static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+// bands smaller than this aren't worth a thread, and compress worse for not seeing earlier rows
+static const size_t minBandBytes = 256 * 1024;
+
+enum Filter { NONE, SUB, UP, AVERAGE, PAETH };
+
+struct CrcTable {
+	unsigned int entries[256];
+
+	CrcTable() {
+		for(unsigned int n = 0; n < 256; n++) {
+			unsigned int c = n;
+			for(int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			entries[n] = c;
+		}
+	}
+};
+
+static unsigned int crc32(const unsigned char *data, size_t size) {
+	static const CrcTable table;
+
+	unsigned int c = 0xffffffffu;
+	for(size_t i = 0; i < size; i++)
+		c = table.entries[(c ^ data[i]) & 0xff] ^ (c >> 8);
+	return c ^ 0xffffffffu;
+}
+
+static void append32(std::vector<unsigned char> & out, unsigned int value) {
+	out.push_back((unsigned char) (value >> 24));
+	out.push_back((unsigned char) (value >> 16));
+	out.push_back((unsigned char) (value >> 8));
+	out.push_back((unsigned char) value);
+}
+
+// chunk data is written after beginChunk() straight into out, endChunk() fills in its length and checksum
+static size_t beginChunk(std::vector<unsigned char> & out, const char *type) {
+	size_t start = out.size();
+	append32(out, 0);
+	out.insert(out.end(), type, type + 4);
+	return start;
+}
+
+static void endChunk(std::vector<unsigned char> & out, size_t start) {
+	size_t length = out.size() - start - 8;
+	for(int i = 0; i < 4; i++)
+		out[start + i] = (unsigned char) (length >> (24 - i * 8));
+
+	append32(out, crc32(out.data() + start + 4, length + 4));
+}
+
+static int paeth(int a, int b, int c) {
+	int pa = abs(b - c);
+	int pb = abs(a - c);
+	int pc = abs(a + b - 2 * c);
+	if(pa <= pb && pa <= pc) return a;
+	return pb <= pc ? b : c;
+}
+
+// a is the byte bpp to the left, b the one above, c the one above a; all zero outside the image
+static int predict(int filter, int a, int b, int c) {
+	switch(filter) {
+	case SUB: return a;
+	case UP: return b;
+	case AVERAGE: return (a + b) >> 1;
+	case PAETH: return paeth(a, b, c);
+	default: return 0;
+	}
+}
+
+#ifdef PNG_SSE2
+
+static inline __m128i abs16(__m128i v) {
+	return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+static inline __m128i blend(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i paeth8(__m128i a, __m128i b, __m128i c) {
+	__m128i pa = _mm_sub_epi16(b, c);
+	__m128i pb = _mm_sub_epi16(a, c);
+	__m128i pc = abs16(_mm_add_epi16(pa, pb));
+	pa = abs16(pa);
+	pb = abs16(pb);
+
+	__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+	return blend(_mm_cmpeq_epi16(pa, smallest), a, blend(_mm_cmpeq_epi16(pb, smallest), b, c));
+}
+
+// predict() for 16 bytes at once
+static inline __m128i predict16(int filter, __m128i a, __m128i b, __m128i c) {
+	const __m128i zero = _mm_setzero_si128();
+
+	switch(filter) {
+	case SUB: return a;
+	case UP: return b;
+	// average rounding down, where _mm_avg_epu8 rounds up
+	case AVERAGE: return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+	case PAETH: return _mm_packus_epi16(
+		paeth8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+		paeth8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+	default: return zero;
+	}
+}
+
+// adds up magnitudes of bytes taken as signed values, into the low 16 bits of each 64 bit half
+static inline __m128i sumAbs(__m128i v) {
+	return _mm_sad_epu8(_mm_min_epu8(v, _mm_sub_epi8(_mm_setzero_si128(), v)), _mm_setzero_si128());
+}
+
+#endif
+
+// Writes the filter type and the filtered row to out. The filter is the one whose output has the smallest
+// sum of bytes taken as signed values, which tends to compress best; all of them are scored in one pass.
+static void filterRow(const unsigned char *row, const unsigned char *prior, size_t n, int bpp, unsigned char *out) {
+	// the first pixel has no left neighbours
+	size_t first = std::min((size_t) bpp, n);
+
+	unsigned int scores[5] = { 0 };
+	for(size_t i = 0; i < first; i++)
+		for(int f = NONE; f <= PAETH; f++)
+			scores[f] += abs((signed char) (row[i] - predict(f, 0, prior[i], 0)));
+
+	size_t i = first;
+#ifdef PNG_SSE2
+	__m128i sums[5];
+	for(int f = NONE; f <= PAETH; f++)
+		sums[f] = _mm_setzero_si128();
+
+	for(; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (row + i));
+		__m128i a = _mm_loadu_si128((const __m128i *) (row + i - bpp));
+		__m128i b = _mm_loadu_si128((const __m128i *) (prior + i));
+		__m128i c = _mm_loadu_si128((const __m128i *) (prior + i - bpp));
+
+		sums[NONE] = _mm_add_epi64(sums[NONE], sumAbs(x));
+		for(int f = SUB; f <= PAETH; f++)
+			sums[f] = _mm_add_epi64(sums[f], sumAbs(_mm_sub_epi8(x, predict16(f, a, b, c))));
+	}
+
+	for(int f = NONE; f <= PAETH; f++)
+		scores[f] += _mm_cvtsi128_si32(sums[f]) + _mm_cvtsi128_si32(_mm_srli_si128(sums[f], 8));
+#endif
+	for(; i < n; i++)
+		for(int f = NONE; f <= PAETH; f++)
+			scores[f] += abs((signed char) (row[i] - predict(f, row[i - bpp], prior[i], prior[i - bpp])));
+
+	int best = NONE;
+	for(int f = SUB; f <= PAETH; f++)
+		if(scores[f] < scores[best]) best = f;
+
+	out[0] = (unsigned char) best;
+	out++;
+
+	for(i = 0; i < first; i++)
+		out[i] = (unsigned char) (row[i] - predict(best, 0, prior[i], 0));
+#ifdef PNG_SSE2
+	for(; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (row + i));
+		__m128i a = _mm_loadu_si128((const __m128i *) (row + i - bpp));
+		__m128i b = _mm_loadu_si128((const __m128i *) (prior + i));
+		__m128i c = _mm_loadu_si128((const __m128i *) (prior + i - bpp));
+		_mm_storeu_si128((__m128i *) (out + i), _mm_sub_epi8(x, predict16(best, a, b, c)));
+	}
+#endif
+	for(; i < n; i++)
+		out[i] = (unsigned char) (row[i] - predict(best, row[i - bpp], prior[i], prior[i - bpp]));
+}
+
+struct Band {
+	int first, last; // rows
+	std::vector<unsigned char> compressed;
+	unsigned int adler;
+	size_t size; // of the filtered data
+};
+
+static void encodeBand(const unsigned char *pixels, int w, int channels, bool lastBand, Band *band) {
+	size_t rowBytes = (size_t) w * channels;
+	std::vector<unsigned char> filtered((rowBytes + 1) * (band->last - band->first));
+
+	// opaque images drop alpha, which needs rows converted; RGBA rows are filtered where they are
+	std::vector<unsigned char> converted[2];
+	auto row = [&](int y, int slot) -> const unsigned char * {
+		const unsigned char *source = pixels + (size_t) y * w * 4;
+		if(channels == 4) return source;
+
+		converted[slot].resize(rowBytes);
+		unsigned char *dest = converted[slot].data();
+		for(int x = 0; x < w; x++) {
+			dest[x * 3] = source[x * 4];
+			dest[x * 3 + 1] = source[x * 4 + 1];
+			dest[x * 3 + 2] = source[x * 4 + 2];
+		}
+		return dest;
+	};
+
+	std::vector<unsigned char> zeros(rowBytes, 0);
+	const unsigned char *prior = band->first == 0 ? zeros.data() : row(band->first - 1, 0);
+	for(int y = band->first; y < band->last; y++) {
+		const unsigned char *current = row(y, (y - band->first + 1) & 1);
+		filterRow(current, prior, rowBytes, channels, &filtered[(y - band->first) * (rowBytes + 1)]);
+		prior = current;
+	}
+
+	band->size = filtered.size();
+	band->adler = adler32(filtered.data(), filtered.size());
+	deflatePiece(filtered.data(), filtered.size(), lastBand, band->compressed);
+}
+
+void pngEncode(const unsigned char *pixels, int w, int h, int threads, std::vector<unsigned char> & out) {
+	size_t count = (size_t) w * h;
+	bool opaque = true;
+	for(size_t i = 0; i < count && opaque; i++)
+		opaque = pixels[i * 4 + 3] == 255;
+	int channels = opaque ? 3 : 4;
+
+	size_t rowBytes = (size_t) w * channels + 1;
+	int bandCount = (int) ((rowBytes * h) / minBandBytes);
+	if(bandCount > threads) bandCount = threads;
+	if(bandCount > h) bandCount = h;
+	if(bandCount < 1) bandCount = 1;
+
+	std::vector<Band> bands(bandCount);
+	for(int i = 0; i < bandCount; i++) {
+		bands[i].first = (int) ((long long) h * i / bandCount);
+		bands[i].last = (int) ((long long) h * (i + 1) / bandCount);
+	}
+
+	std::vector<std::thread> workers;
+	for(int i = 1; i < bandCount; i++)
+		workers.push_back(std::thread(encodeBand, pixels, w, channels, i == bandCount - 1, &bands[i]));
+	encodeBand(pixels, w, channels, bandCount == 1, &bands[0]);
+	for(auto & worker : workers)
+		worker.join();
+
+	out.insert(out.end(), signature, signature + sizeof(signature));
+
+	size_t chunk = beginChunk(out, "IHDR");
+	append32(out, w);
+	append32(out, h);
+	out.push_back(8);
+	out.push_back(opaque ? 2 : 6);
+	out.push_back(0);
+	out.push_back(0);
+	out.push_back(0);
+	endChunk(out, chunk);
+
+	size_t compressed = 0;
+	for(const auto & band : bands)
+		compressed += band.compressed.size();
+	out.reserve(out.size() + compressed + 64);
+
+	chunk = beginChunk(out, "IDAT");
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	unsigned int adler = bands[0].adler;
+	for(int i = 0; i < bandCount; i++) {
+		out.insert(out.end(), bands[i].compressed.begin(), bands[i].compressed.end());
+		if(i > 0) adler = adler32Combine(adler, bands[i].adler, bands[i].size);
+	}
+	append32(out, adler);
+	endChunk(out, chunk);
+
+	chunk = beginChunk(out, "IEND");
+	endChunk(out, chunk);
+}
@@ -0,0 +1,12 @@
+#ifndef __PNG_ENCODE_H__
+#define __PNG_ENCODE_H__
+
+#include <vector>
+
+// PNG encoder, the counterpart of png-decode.cc. The image is cut into bands of rows that are filtered
+// and compressed on separate threads, then joined into a single zlib stream.
+
+/// Appends a PNG of w * h 32 bit RGBA pixels to out, using up to threads threads. Fully opaque images are stored without alpha.
+void pngEncode(const unsigned char *pixels, int w, int h, int threads, std::vector<unsigned char> & out);
+
+#endif
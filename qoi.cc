@@ -0,0 +1,197 @@
+#include "qoi.h"
+#include <cstring>
+
+static const int headerSize = 14;
+static const unsigned char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+// same limit as png-decode.cc
+static const unsigned int maxPixels = 1 << 26;
+
+enum {
+	OP_INDEX = 0x00, // 00iiiiii: color from the index
+	OP_DIFF = 0x40,  // 01rrggbb: each channel changed by -2..1
+	OP_LUMA = 0x80,  // 10gggggg rrrrbbbb: green changed by -32..31, red and blue by -8..7 more than green
+	OP_RUN = 0xc0,   // 11llllll: previous color repeated 1..62 times
+	OP_RGB = 0xfe,
+	OP_RGBA = 0xff,
+	OP_MASK = 0xc0,
+};
+
+struct Pixel {
+	unsigned char r, g, b, a;
+};
+
+static int indexOf(Pixel p) {
+	return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) & 63;
+}
+
+static bool equal(Pixel p, Pixel q) {
+	return p.r == q.r && p.g == q.g && p.b == q.b && p.a == q.a;
+}
+
+static unsigned int read32(const unsigned char *p) {
+	return ((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) | ((unsigned int) p[2] << 8) | p[3];
+}
+
+static void write32(unsigned char *p, unsigned int value) {
+	p[0] = (unsigned char) (value >> 24);
+	p[1] = (unsigned char) (value >> 16);
+	p[2] = (unsigned char) (value >> 8);
+	p[3] = (unsigned char) value;
+}
+
+bool qoiSignature(const unsigned char *data, size_t size) {
+	return size >= 4 && memcmp(data, "qoif", 4) == 0;
+}
+
+unsigned char *qoiDecode(const unsigned char *data, size_t size, int *w, int *h) {
+	if(size < headerSize + sizeof(padding) || !qoiSignature(data, size)) return NULL;
+
+	unsigned int width = read32(data + 4);
+	unsigned int height = read32(data + 8);
+	int channels = data[12];
+	if(width == 0 || height == 0 || width > maxPixels / height) return NULL;
+	if(channels != 3 && channels != 4) return NULL;
+
+	Pixel index[64];
+	memset(index, 0, sizeof(index));
+
+	Pixel px = { 0, 0, 0, 255 };
+
+	// no code is longer than 5 bytes, and the end marker follows the last one, so codes starting before
+	// end can be read without checking each byte
+	const unsigned char *in = data + headerSize;
+	const unsigned char *end = data + size - sizeof(padding);
+
+	size_t count = (size_t) width * height;
+	unsigned char *pixels = new unsigned char[count * 4];
+	Pixel *out = (Pixel *) pixels;
+	Pixel *last = out + count;
+
+	while(out < last) {
+		if(in >= end) {
+			delete[] pixels;
+			return NULL;
+		}
+
+		int b1 = *in++;
+		if(b1 == OP_RGB) {
+			px.r = in[0];
+			px.g = in[1];
+			px.b = in[2];
+			in += 3;
+		} else if(b1 == OP_RGBA) {
+			px.r = in[0];
+			px.g = in[1];
+			px.b = in[2];
+			px.a = in[3];
+			in += 4;
+		} else if((b1 & OP_MASK) == OP_INDEX) {
+			px = index[b1];
+		} else if((b1 & OP_MASK) == OP_DIFF) {
+			px.r += ((b1 >> 4) & 3) - 2;
+			px.g += ((b1 >> 2) & 3) - 2;
+			px.b += (b1 & 3) - 2;
+		} else if((b1 & OP_MASK) == OP_LUMA) {
+			int b2 = *in++;
+			int vg = (b1 & 63) - 32;
+			px.r += vg - 8 + ((b2 >> 4) & 15);
+			px.g += vg;
+			px.b += vg - 8 + (b2 & 15);
+		} else {
+			// a run can repeat the initial color, which isn't in the index until then
+			size_t run = (b1 & 63) + 1;
+			if(run > (size_t) (last - out)) run = last - out;
+			for(size_t i = 0; i < run; i++)
+				out[i] = px;
+			out += run;
+			index[indexOf(px)] = px;
+			continue;
+		}
+
+		index[indexOf(px)] = px;
+		*out++ = px;
+	}
+
+	*w = (int) width;
+	*h = (int) height;
+	return pixels;
+}
+
+unsigned char *qoiEncode(const unsigned char *pixels, int w, int h, size_t *size) {
+	size_t count = (size_t) w * h;
+	unsigned char *data = new unsigned char[headerSize + count * 5 + sizeof(padding)];
+
+	memcpy(data, "qoif", 4);
+	write32(data + 4, w);
+	write32(data + 8, h);
+	data[12] = 4;
+	data[13] = 0; // sRGB with linear alpha
+
+	Pixel index[64];
+	memset(index, 0, sizeof(index));
+
+	Pixel prev = { 0, 0, 0, 255 };
+	const Pixel *in = (const Pixel *) pixels;
+	unsigned char *out = data + headerSize;
+	int run = 0;
+
+	for(size_t i = 0; i < count; i++) {
+		Pixel px = in[i];
+
+		if(equal(px, prev)) {
+			run++;
+			if(run == 62 || i == count - 1) {
+				*out++ = (unsigned char) (OP_RUN | (run - 1));
+				run = 0;
+			}
+			continue;
+		}
+
+		if(run > 0) {
+			*out++ = (unsigned char) (OP_RUN | (run - 1));
+			run = 0;
+		}
+
+		int slot = indexOf(px);
+		if(equal(index[slot], px)) {
+			*out++ = (unsigned char) (OP_INDEX | slot);
+		} else {
+			index[slot] = px;
+
+			if(px.a == prev.a) {
+				signed char vr = (signed char) (px.r - prev.r);
+				signed char vg = (signed char) (px.g - prev.g);
+				signed char vb = (signed char) (px.b - prev.b);
+				signed char vgr = (signed char) (vr - vg);
+				signed char vgb = (signed char) (vb - vg);
+
+				if(vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+					*out++ = (unsigned char) (OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+				} else if(vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+					*out++ = (unsigned char) (OP_LUMA | (vg + 32));
+					*out++ = (unsigned char) ((vgr + 8) << 4 | (vgb + 8));
+				} else {
+					*out++ = OP_RGB;
+					*out++ = px.r;
+					*out++ = px.g;
+					*out++ = px.b;
+				}
+			} else {
+				*out++ = OP_RGBA;
+				*out++ = px.r;
+				*out++ = px.g;
+				*out++ = px.b;
+				*out++ = px.a;
+			}
+		}
+
+		prev = px;
+	}
+
+	memcpy(out, padding, sizeof(padding));
+	out += sizeof(padding);
+
+	*size = out - data;
+	return data;
+}
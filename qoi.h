@@ -0,0 +1,17 @@
+#ifndef __QOI_H__
+#define __QOI_H__
+
+#include <cstddef>
+
+// The QOI image format (https://qoiformat.org): lossless like PNG, but with no compression beyond a few
+// byte codes for runs and small color changes, so it decodes several times faster. Pixels are 32 bit RGBA.
+
+bool qoiSignature(const unsigned char *data, size_t size);
+
+/// Returns pixels in an array the caller owns, or NULL if the image is malformed. 3 channel images get opaque alpha.
+unsigned char *qoiDecode(const unsigned char *data, size_t size, int *w, int *h);
+
+/// Returns the encoded image in an array the caller owns, and its length in size.
+unsigned char *qoiEncode(const unsigned char *pixels, int w, int h, size_t *size);
+
+#endif
@@ -0,0 +1,143 @@
+#include "scale.h"
+#include <cstring>
+#include <vector>
+
+void scaleInteger(const unsigned int *src, int w, int h, unsigned int *dst, int scaling) {
+	int neww = w * scaling;
+
+	for(int y = 0; y < h; y++) {
+		unsigned int *row = dst + y * scaling * neww;
+		const unsigned int *source = src + y * w;
+
+		unsigned int *out = row;
+		for(int x = 0; x < w; x++) {
+			unsigned int pixel = source[x];
+			for(int i = 0; i < scaling; i++)
+				*out++ = pixel;
+		}
+
+		for(int i = 1; i < scaling; i++)
+			memcpy(row + i * neww, row, neww * sizeof(unsigned int));
+	}
+}
+
+// index of the source pixel whose center is nearest to the center of each destination pixel
+static std::vector<int> nearestMap(int size, int newsize) {
+	std::vector<int> map(newsize);
+	for(int i = 0; i < newsize; i++) {
+		int source = (int) ((i + 0.5) * size / newsize);
+		map[i] = source < size ? source : size - 1;
+	}
+	return map;
+}
+
+void scaleNearest(const unsigned int *src, int w, int h, unsigned int *dst, int neww, int newh) {
+	std::vector<int> columns = nearestMap(w, neww);
+	std::vector<int> rows = nearestMap(h, newh);
+
+	for(int y = 0; y < newh; y++) {
+		unsigned int *row = dst + y * neww;
+		if(y > 0 && rows[y] == rows[y - 1]) {
+			memcpy(row, row - neww, neww * sizeof(unsigned int));
+			continue;
+		}
+
+		const unsigned int *source = src + rows[y] * w;
+		for(int x = 0; x < neww; x++)
+			row[x] = source[columns[x]];
+	}
+}
+
+struct BilinearTap {
+	int first;
+	int second;
+	float weight; // of second
+};
+
+static std::vector<BilinearTap> bilinearTaps(int size, int newsize) {
+	std::vector<BilinearTap> taps(newsize);
+	for(int i = 0; i < newsize; i++) {
+		float position = (i + 0.5f) * size / newsize - 0.5f;
+		if(position < 0) position = 0;
+
+		int first = (int) position;
+		if(first > size - 1) first = size - 1;
+
+		taps[i].first = first;
+		taps[i].second = first + 1 < size ? first + 1 : first;
+		taps[i].weight = position - first;
+	}
+	return taps;
+}
+
+// one source row interpolated horizontally, as alpha-premultiplied floats
+static void bilinearRow(const unsigned int *source, const std::vector<BilinearTap> & columns, float *out) {
+	for(size_t x = 0; x < columns.size(); x++) {
+		const unsigned char *a = (const unsigned char *) &source[columns[x].first];
+		const unsigned char *b = (const unsigned char *) &source[columns[x].second];
+		float wb = columns[x].weight;
+		float wa = 1 - wb;
+
+		float alphaA = a[3] * wa;
+		float alphaB = b[3] * wb;
+
+		out[0] = a[0] * alphaA + b[0] * alphaB;
+		out[1] = a[1] * alphaA + b[1] * alphaB;
+		out[2] = a[2] * alphaA + b[2] * alphaB;
+		out[3] = alphaA + alphaB;
+		out += 4;
+	}
+}
+
+static inline unsigned char toByte(float value) {
+	if(value <= 0) return 0;
+	if(value >= 255) return 255;
+	return (unsigned char) (value + 0.5f);
+}
+
+void scaleBilinear(const unsigned int *src, int w, int h, unsigned int *dst, int neww, int newh) {
+	std::vector<BilinearTap> columns = bilinearTaps(w, neww);
+	std::vector<BilinearTap> rows = bilinearTaps(h, newh);
+
+	// horizontally interpolated source rows, kept while consecutive destination rows still need them
+	std::vector<float> top(neww * 4), bottom(neww * 4);
+	int topRow = -1, bottomRow = -1;
+
+	for(int y = 0; y < newh; y++) {
+		const BilinearTap & tap = rows[y];
+
+		if(tap.first == bottomRow && tap.first != topRow) {
+			top.swap(bottom);
+			topRow = bottomRow;
+			bottomRow = -1;
+		}
+		if(tap.first != topRow) {
+			bilinearRow(src + tap.first * w, columns, top.data());
+			topRow = tap.first;
+		}
+		if(tap.second != bottomRow) {
+			bilinearRow(src + tap.second * w, columns, bottom.data());
+			bottomRow = tap.second;
+		}
+
+		float wb = tap.weight;
+		float wa = 1 - wb;
+
+		unsigned char *out = (unsigned char *) (dst + y * neww);
+		for(int x = 0; x < neww; x++) {
+			const float *a = &top[x * 4];
+			const float *b = &bottom[x * 4];
+
+			float alpha = a[3] * wa + b[3] * wb;
+			if(alpha <= 0) {
+				out[0] = out[1] = out[2] = out[3] = 0;
+			} else {
+				out[0] = toByte((a[0] * wa + b[0] * wb) / alpha);
+				out[1] = toByte((a[1] * wa + b[1] * wb) / alpha);
+				out[2] = toByte((a[2] * wa + b[2] * wb) / alpha);
+				out[3] = toByte(alpha);
+			}
+			out += 4;
+		}
+	}
+}
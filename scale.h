@@ -0,0 +1,16 @@
+#ifndef __SCALE_H__
+#define __SCALE_H__
+
+// Scalers for 32 bit RGBA images. They fill dst a row at a time; the nearest neighbour ones
+// copy rows that come out identical instead of computing them again.
+
+/// Nearest neighbour by a whole factor; dst is w * scaling by h * scaling.
+void scaleInteger(const unsigned int *src, int w, int h, unsigned int *dst, int scaling);
+
+/// Nearest neighbour to any size.
+void scaleNearest(const unsigned int *src, int w, int h, unsigned int *dst, int neww, int newh);
+
+/// Bilinear to any size. Colors are weighted by alpha, so transparent pixels don't darken edges.
+void scaleBilinear(const unsigned int *src, int w, int h, unsigned int *dst, int neww, int newh);
+
+#endif
@@ -1,7 +1,17 @@
 #include "sdl-utils.h"
 #include "utils.h"
 #include "xxhash.h"
+#include "swizzle.h"
+#include "outline.h"
+#include "scale.h"
+#include "colormap.h"
+#include "pixel-ops.h"
+#include "bounds.h"
+#include "decode.h"
+#include "encode.h"
 #include <algorithm>
+#include <unordered_map>
+#include <list>
 
 #include "SDL_syswm.h"
 #include "Gdiplus.h"
@@ -139,8 +149,11 @@ Font::Font(const std::string &name, double size) {
 	setFont(new Gdiplus::Font(s2ws(name).c_str(), (Gdiplus::REAL) size, Gdiplus::FontStyleRegular, Gdiplus::UnitPoint));
 }
 
-FileFont::FileFont(const Blob *blob, double size) {
-	privateFontCollection.AddMemoryFont(blob->data, blob->length);
+FileFont::FileFont(Blob *blob, double size) {
+	// slice() loads streamed blobs, the font has to be in memory
+	fontData.slice(blob, 0, blob == NULL ? 0 : blob->length);
+	if(fontData.data != NULL)
+		privateFontCollection.AddMemoryFont(fontData.data, fontData.length);
 
 	init(size);
 }
@@ -202,21 +215,263 @@ void Font::setFont(Gdiplus::Font *f) {
 	DeleteDC(hCaptureDC);
 }
 
+static std::unordered_multimap<unsigned long long, PixelBuffer *> pixelBuffers;
+static size_t pixelBufferSurfaces = 0;
+static size_t pixelBufferBytes = 0;
+static size_t pixelBufferSavedBytes = 0;
+static size_t pixelBufferResidentBytes = 0;
+
+bool PixelStore::releaseAfterUpload = false;
+
+// a hash match alone could be a collision, and sharing those pixels would show the wrong image. Released
+// pixels aren't read back from the texture for that, a 64 bit hash colliding is too unlikely to be worth it
+static bool samePixels(PixelBuffer *buffer, const unsigned char *pixels, int w, int h) {
+	if(buffer->width != w || buffer->height != h) return false;
+
+	return buffer->pixels == NULL || memcmp(buffer->pixels, pixels, (size_t) w * h * 4) == 0;
+}
+
+PixelBuffer *PixelStore::intern(unsigned char *pixels, int w, int h, unsigned long long hash, std::shared_ptr<void> storage) {
+	auto range = pixelBuffers.equal_range(hash);
+	for(auto iter = range.first; iter != range.second; ++iter) {
+		PixelBuffer *buffer = iter->second;
+		if(!samePixels(buffer, pixels, w, h)) continue;
+
+		if(!storage) delete[] pixels;
+		return share(buffer);
+	}
+
+	size_t size = (size_t) w * h * 4;
+	pixelBufferSurfaces++;
+
+	PixelBuffer *buffer = new PixelBuffer;
+	buffer->pixels = pixels;
+	buffer->width = w;
+	buffer->height = h;
+	buffer->hash = hash;
+	buffer->textureId = 0;
+	buffer->refs = 1;
+	buffer->views = 0;
+	buffer->storage = storage;
+
+	pixelBuffers.insert(std::make_pair(hash, buffer));
+	pixelBufferBytes += size;
+	pixelBufferResidentBytes += size;
+	return buffer;
+}
+
+PixelBuffer *PixelStore::share(PixelBuffer *buffer) {
+	// a copy is saved only if another surface has the same pixels, not just views or caches
+	if(buffer->refs > buffer->views)
+		pixelBufferSavedBytes += (size_t) buffer->width * buffer->height * 4;
+
+	pixelBufferSurfaces++;
+	buffer->refs++;
+	return buffer;
+}
+
+unsigned char *PixelStore::pixels(PixelBuffer *buffer) {
+	if(buffer->pixels != NULL) return buffer->pixels;
+
+	size_t size = (size_t) buffer->width * buffer->height * 4;
+	buffer->pixels = new unsigned char[size];
+
+	GLint previous = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+	glBindTexture(GL_TEXTURE_2D, buffer->textureId);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, buffer->pixels);
+	glBindTexture(GL_TEXTURE_2D, previous);
+
+	pixelBufferResidentBytes += size;
+	return buffer->pixels;
+}
+
+GLuint PixelStore::texture(PixelBuffer *buffer) {
+	if(buffer->textureId == 0)
+		buffer->textureId = glTexture(buffer->pixels, buffer->width, buffer->height);
+
+	if(releaseAfterUpload)
+		releasePixels(buffer);
+
+	return buffer->textureId;
+}
+
+static void freePixels(PixelBuffer *buffer) {
+	if(buffer->storage)
+		buffer->storage.reset();
+	else
+		delete[] buffer->pixels;
+
+	buffer->pixels = NULL;
+}
+
+void PixelStore::releasePixels(PixelBuffer *buffer) {
+	if(buffer->pixels == NULL) return;
+
+	// the texture is the only copy left afterwards
+	if(buffer->textureId == 0)
+		buffer->textureId = glTexture(buffer->pixels, buffer->width, buffer->height);
+
+	freePixels(buffer);
+	pixelBufferResidentBytes -= (size_t) buffer->width * buffer->height * 4;
+}
+
+// forgets one reference, returns true if it was the last one and buffer is no longer in the store
+static bool unreference(PixelBuffer *buffer, bool view) {
+	size_t size = (size_t) buffer->width * buffer->height * 4;
+
+	// only surfaces that were interned saved a copy; views and caches never had one of their own
+	if(view)
+		buffer->views--;
+	else if(buffer->refs - buffer->views > 1)
+		pixelBufferSavedBytes -= size;
+
+	if(--buffer->refs > 0)
+		return false;
+
+	auto range = pixelBuffers.equal_range(buffer->hash);
+	for(auto iter = range.first; iter != range.second; ++iter) {
+		if(iter->second == buffer) {
+			pixelBuffers.erase(iter);
+			break;
+		}
+	}
+
+	pixelBufferBytes -= size;
+	if(buffer->pixels != NULL)
+		pixelBufferResidentBytes -= size;
+	if(buffer->textureId != 0)
+		glDeleteTextures(1, &buffer->textureId);
+
+	return true;
+}
+
+void PixelStore::addView(PixelBuffer *buffer) {
+	buffer->refs++;
+	buffer->views++;
+	pixelBufferSurfaces++;
+}
+
+void PixelStore::release(PixelBuffer *buffer, bool view) {
+	pixelBufferSurfaces--;
+	if(!unreference(buffer, view)) return;
+
+	freePixels(buffer);
+	delete buffer;
+}
+
+void PixelStore::hold(PixelBuffer *buffer) {
+	buffer->refs++;
+	buffer->views++;
+}
+
+void PixelStore::forget(PixelBuffer *buffer) {
+	if(!unreference(buffer, true)) return;
+
+	freePixels(buffer);
+	delete buffer;
+}
+
+void PixelStore::setReleaseAfterUpload(bool release) {
+	releaseAfterUpload = release;
+}
+
+int PixelStore::stats(lua_State *L) {
+	lua_createtable(L, 0, 5);
+	lua_pushnumber(L, (lua_Number) pixelBuffers.size());
+	lua_setfield(L, -2, "buffers");
+	lua_pushnumber(L, (lua_Number) pixelBufferSurfaces);
+	lua_setfield(L, -2, "surfaces");
+	lua_pushnumber(L, (lua_Number) pixelBufferBytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushnumber(L, (lua_Number) pixelBufferSavedBytes);
+	lua_setfield(L, -2, "savedBytes");
+	lua_pushnumber(L, (lua_Number) pixelBufferResidentBytes);
+	lua_setfield(L, -2, "residentBytes");
+
+	return 1;
+}
+
+struct ColorMapCacheKey {
+	unsigned long long sourceHash;
+	unsigned long long mapHash;
+	int w, h;
+
+	bool operator==(const ColorMapCacheKey & other) const {
+		return sourceHash == other.sourceHash && mapHash == other.mapHash && w == other.w && h == other.h;
+	}
+};
+
+struct ColorMapCacheKeyHash {
+	size_t operator()(const ColorMapCacheKey & key) const {
+		// both hashes are already XXH64, mixing them is enough
+		return (size_t) (key.sourceHash ^ (key.mapHash * 0x9e3779b97f4a7c15ull) ^ ((unsigned long long) key.w << 32) ^ key.h);
+	}
+};
+
+struct ColorMapCacheItem {
+	ColorMapCacheKey key;
+	PixelBuffer *buffer;
+};
+
+static std::list<ColorMapCacheItem> colorMapCacheItems; // most recently used first
+static std::unordered_map<ColorMapCacheKey, std::list<ColorMapCacheItem>::iterator, ColorMapCacheKeyHash> colorMapCacheIndex;
+static size_t colorMapCacheUsed = 0;
+
+size_t ColorMapCache::capacity = 16 * 1024 * 1024;
+
+PixelBuffer *ColorMapCache::find(unsigned long long sourceHash, int w, int h, const ColorMap & map) {
+	auto found = colorMapCacheIndex.find({ sourceHash, map.hash, w, h });
+	if(found == colorMapCacheIndex.end()) return NULL;
+
+	colorMapCacheItems.splice(colorMapCacheItems.begin(), colorMapCacheItems, found->second);
+	return found->second->buffer;
+}
+
+void ColorMapCache::put(unsigned long long sourceHash, int w, int h, const ColorMap & map, PixelBuffer *buffer) {
+	size_t size = (size_t) buffer->width * buffer->height * 4;
+	if(size > capacity / 4) return;
+
+	ColorMapCacheKey key = { sourceHash, map.hash, w, h };
+	if(colorMapCacheIndex.count(key) != 0) return;
+
+	PixelStore::hold(buffer);
+	colorMapCacheItems.push_front({ key, buffer });
+	colorMapCacheIndex[key] = colorMapCacheItems.begin();
+	colorMapCacheUsed += size;
+
+	while(colorMapCacheUsed > capacity) {
+		ColorMapCacheItem & oldest = colorMapCacheItems.back();
+		colorMapCacheUsed -= (size_t) oldest.buffer->width * oldest.buffer->height * 4;
+		colorMapCacheIndex.erase(oldest.key);
+		PixelStore::forget(oldest.buffer);
+		colorMapCacheItems.pop_back();
+	}
+}
+
 void Surface::init() {
 	pixelData = NULL;
-	textureId = 0;
+	buffer = NULL;
+	view = false;
+	viewx = 0;
+	viewy = 0;
 	hash = 0;
 	width = 0;
 	height = 0;
 	padl = 0;
 	padr = 0;
+	offx = 0;
+	offy = 0;
+	fullw = 0;
+	fullh = 0;
 }
 
 Surface::~Surface() {
+	if(buffer != NULL)
+		PixelStore::release(buffer, view);
 	if(pixelData != NULL)
 		delete[] pixelData;
-	if(textureId != 0)
-		glDeleteTextures(1, &textureId);
 }
 
 void Surface::setBitmap(HBITMAP hCaptureBitmap, int sx, int sy, int w, int h) {
@@ -241,6 +496,7 @@ void Surface::setBitmap(HBITMAP hCaptureBitmap, int sx, int sy, int w, int h) {
 	::GetDIBits(hCaptureDC, hCaptureBitmap, 0, nScreenHeight, pixels, &bmpInfo, DIB_RGB_COLORS);
 
 	setBitmap(pixels, sx, sy, w, h, nScreenWidth * 4);
+	createSurfaceFromPixelData(w, h);
 
 	delete[] pixels;
 
@@ -256,29 +512,57 @@ void Surface::setBitmap(void *data, int sx, int sy, int w, int h, int stride) {
 		initial = (sy + h - 1) * -stride;
 	}
 
-	for(int y = 0; y < h; y++) {
-		unsigned char *dst = pixelData + (y * w * 4);
-		unsigned char *src = pixels + (initial + sx * 4 + (sy + y) * stride);
+	swizzleRows(pixelData, pixels + (initial + sx * 4 + sy * stride), w, h, stride);
 
-		for(int x = 0; x < w; x++) {
-			dst[0] = src[2];
-			dst[1] = src[1];
-			dst[2] = src[0];
-			dst[3] = src[3];
-
-			dst += 4;
-			src += 4;
-		}
-	}
+	width = w;
+	height = h;
+}
 
-	createSurfaceFromPixelData(w, h);
+void Surface::createSurfaceFromPixelData(int w, int h) {
+	createSurfaceFromPixelData(w, h, XXH64(pixelData, w * h * 4, 0), nullptr);
 }
 
-void Surface::createSurfaceFromPixelData(int w, int h){
-	hash = XXH64(pixelData, w * h * 4, 0);
+// for pixels whose hash is already known, like decoded ones; pixelData points into cached if that's given
+void Surface::createSurfaceFromPixelData(int w, int h, unsigned long long hash, std::shared_ptr<CachedImage> cached) {
+	this->hash = hash;
 
 	width = w;
 	height = h;
+	fullw = std::max(fullw, offx + w);
+	fullh = std::max(fullh, offy + h);
+
+	buffer = PixelStore::intern(pixelData, w, h, hash, cached);
+	pixelData = NULL;
+}
+
+// pixels are shared once createSurfaceFromPixelData is called, so they must not be modified after that
+unsigned char *Surface::pixels() {
+	if(buffer == NULL) return pixelData;
+
+	unsigned char *all = PixelStore::pixels(buffer);
+	if(!view || (width == buffer->width && height == buffer->height))
+		return all;
+
+	// rows of a view are parts of its buffer's rows; they are copied out the first time they're needed in one piece
+	if(pixelData == NULL) {
+		pixelData = new unsigned char[width * height * 4];
+		for(int y = 0; y < height; y++)
+			memcpy(pixelData + y * width * 4, all + ((viewy + y) * buffer->width + viewx) * 4, width * 4);
+	}
+
+	return pixelData;
+}
+
+GLint Surface::texture() {
+	if(!isValid()) return 0;
+
+	return PixelStore::texture(buffer);
+}
+
+void Surface::releasePixels() {
+	if(!isValid()) return;
+
+	PixelStore::releasePixels(buffer);
 }
 
 void Surface::setBitmap(Gdiplus::Bitmap *bitmap) {
@@ -295,67 +579,64 @@ void Surface::setBitmap(Gdiplus::Bitmap *bitmap) {
 	delete bitmapData;
 }
 
-Surface::Surface(const std::string &filename) {
+Surface::Surface(const std::string &filename, SurfaceDecode decode) {
 	init();
 
-	std::wstring ws = s2ws(filename);
-	Gdiplus::Bitmap *bitmap = Gdiplus::Bitmap::FromFile(ws.c_str(), false);
-	if(bitmap == NULL) {
+	if(decode == DECODE_ASYNC) {
+		pending = std::make_shared<DecodeJob>();
+		pending->filename = filename;
+		DecodeQueue::push(pending);
+		return;
+	}
+
+	int w, h;
+	unsigned long long decodedHash;
+	std::shared_ptr<CachedImage> cached;
+	if(!ImageCache::decode(filename, &pixelData, &w, &h, &decodedHash, cached)) {
 		::log("couldn't open picture: %s\n", filename.c_str());
 		exit(1);
 	}
 
-	setBitmap(bitmap);
-
-	delete bitmap;
+	createSurfaceFromPixelData(w, h, decodedHash, cached);
 }
 
-Surface::Surface(Blob *blob) {
+Surface::Surface(Blob *blob, SurfaceDecode decode) {
 	init();
 
-	Gdiplus::Bitmap *bitmap = Gdiplus::Bitmap::FromStream(blob, false);
-	if(bitmap == NULL) {
-		::log("couldn't open picture from blob\n", blob->source.c_str());
-		exit(1);
-	}
+	if(decode == DECODE_ASYNC) {
+		pending = std::make_shared<DecodeJob>();
 
-	setBitmap(bitmap);
+		// a streamed file is opened again by the worker, so it isn't read here while Lua waits
+		BlobFromFileStream *stream = dynamic_cast<BlobFromFileStream *>(blob);
+		if(stream != NULL && stream->data == NULL) {
+			pending->filename = stream->filename;
+			DecodeQueue::push(pending);
+			return;
+		}
 
-	delete bitmap;
+		// the worker gets its own copy of the bytes, as the blob may be collected by Lua before it's done;
+		// sharing its storage instead could release a Lua string's reference on the worker's thread
+		unsigned char *bytes = pending->blob.allocate(blob->length);
+		ULONG read = 0;
+		blob->reset();
+		blob->Read(bytes, blob->length, &read);
+		blob->reset();
 
-	blob->reset();
-}
-
-UINT findLeftPadding(Gdiplus::BitmapData* bitmapData, UINT width, UINT height) {
-	UINT *rawBitmapData = (UINT*)bitmapData->Scan0;
-	UINT padding = 0;
-	for (UINT x = 0; x < width; x++) {
-		for (UINT y = 0; y < height; y++) {
-			UINT color = rawBitmapData[y * bitmapData->Stride / 4 + x];
-			int red = (color & 0xff0000) >> 16;
-			if (red != NULL) {
-				return padding;
-			}
-		}
-		padding++;
+		DecodeQueue::push(pending);
+		return;
 	}
-	return padding;
-}
 
-int findRightPadding(Gdiplus::BitmapData* bitmapData, UINT width, UINT height) {
-	UINT *rawBitmapData = (UINT*)bitmapData->Scan0;
-	int padding = 0;
-	for (int x = width - 1; x >= 0; x--) {
-		for (int y = 0; y < height; y++) {
-			UINT color = rawBitmapData[y * bitmapData->Stride / 4 + x];
-			int red = (color & 0xff0000) >> 16;
-			if (red != NULL) {
-				return padding;
-			}
-		}
-		padding++;
+	int w, h;
+	unsigned long long decodedHash;
+	std::shared_ptr<CachedImage> cached;
+	if(!ImageCache::decode(blob, &pixelData, &w, &h, &decodedHash, cached)) {
+		::log("couldn't open picture from blob %s\n", blob->source.c_str());
+		exit(1);
 	}
-	return padding;
+
+	createSurfaceFromPixelData(w, h, decodedHash, cached);
+
+	blob->reset();
 }
 
 Surface::Surface(const Font * font, const TextSettings *settings, const std::string &text) {
@@ -401,12 +682,11 @@ Surface::Surface(const Font * font, const TextSettings *settings, const std::str
 	Gdiplus::Rect rect(0, 0, oldWidth, oldHeight);
 	bitmap.LockBits(&rect, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, bitmapData);
 
-	padl = findLeftPadding(bitmapData, oldWidth, oldHeight);
-	padr = findRightPadding(bitmapData, oldWidth, oldHeight);
-
-	if (padl == oldWidth && padr == oldWidth) {
-		padl = 0;
-		padr = 0;
+	// text is drawn in red, so only columns with some red in them count
+	int left, top, right, bottom;
+	if(findBounds((UINT *) bitmapData->Scan0, oldWidth, oldHeight, bitmapData->Stride / 4, 0x00ff0000, &left, &top, &right, &bottom)) {
+		padl = left;
+		padr = oldWidth - right;
 	}
 
 	bitmap.UnlockBits(bitmapData);
@@ -434,88 +714,76 @@ Surface::Surface(const Font * font, const TextSettings *settings, const std::str
 	ReleaseDC(hDesktopWnd, hDesktopDC);
 	DeleteDC(hCaptureDC);
 
-	addOutline(outline, &settings->outlineColor);
+	// outlined before the pixels are shared, so they are hashed and interned once
+	if(outline > 0)
+		addOutline(outline, &settings->outlineColor);
+	createSurfaceFromPixelData(width, height);
 }
 
-void Surface::addOutline(int levels, const Color *color) {
+void Surface::addOutline(int levels, const Color *color, OutlineStyle style) {
 	if(levels == 0) return;
 
-	int colorValue = (0xff << 24) | (color->b << 16) | (color->g << 8) | (color->r);
-
-	int w = width;
-	int h = height;
-
-	unsigned char *data = new unsigned char[w * h * 4];
-	unsigned char *data2 = new unsigned char[w * h * 4];
-
-	memcpy(data, pixelData, 4 * w * h);
-
-	for(int i = 0; i < levels; i++) {
-		memcpy(data2, data, 4 * w * h);
-
-		for(int y = 0; y < h; y++) {
-			for(int x = 0; x < w; x++) {
-				unsigned char *p = &data[(x + y * w) * 4];
-				unsigned char *p2 = &data2[(x + y * w) * 4];
-				if(p[3] > 128) {
-					if(x > 0 && p[-1] < 128)    ((int *) p2)[-1] = colorValue;
-					if(x + 1 < w && p[7] < 128) ((int *) p2)[+1] = colorValue;
-				}
-			}
-		}
-
-		memcpy(data, data2, 4 * w * h);
-
-		for(int y = 0; y < h; y++) {
-			for(int x = 0; x < w; x++) {
-				unsigned char *p = &data[(x + y * w) * 4];
-				unsigned char *p2 = &data2[(x + y * w) * 4];
-				if(p[3] > 128) {
-					if(y > 0 && p[-w * 4 + 3] < 128)    ((int *) p2)[-w] = colorValue;
-					if(y + 1 < h && p[w * 4 + 3] < 128) ((int *) p2)[+w] = colorValue;
-				}
-			}
-		}
-
-		unsigned char *tmp = data;
-		data = data2;
-		data2 = tmp;
-	}
-
-	memcpy(pixelData, data, 4 * w * h);
+	unsigned int colorValue = (0xff << 24) | (color->b << 16) | (color->g << 8) | (color->r);
 
-	delete[] data;
-	delete[] data2;
+	if(style == OUTLINE_ROUND)
+		outlineRound(pixelData, width, height, levels, colorValue);
+	else
+		outlineSquare(pixelData, width, height, levels, colorValue);
 }
 
 bool Surface::isValid() {
 	if(this == NULL) return false;
-	if(pixelData == NULL) return false;
+	if(buffer == NULL && pending) finishDecode();
+	if(buffer == NULL) return false;
 
 	return true;
 }
 
 
-Surface::Surface(Surface *parent, int levels, Color *color) {
+Surface::Surface(Surface *parent, int levels, Color *color, OutlineStyle style) {
 	init();
 
 	if(!parent->isValid()) return;
 
-	int w = parent->w();
-	int h = parent->h();
+	pixelData = (unsigned char *) outlineCanvas(parent, levels);
 
-	unsigned char *data = new unsigned char[w * h * 4];
+	addOutline(levels, color, style);
 
-	memcpy(data, parent->pixelData, 4 * w * h);
+	createSurfaceFromPixelData(width, height);
+}
 
-	pixelData = (unsigned char *) data;
+void Surface::inheritPlacement(Surface *parent) {
+	offx = parent->offx;
+	offy = parent->offy;
+	fullw = parent->fullw;
+	fullh = parent->fullh;
+}
 
-	width = w;
-	height = h;
+// a copy of parent's pixels for outlining; a trimmed parent gets room for an outline levels wide around
+// its pixels, as far as the untrimmed image reaches, so the outline isn't cut off where it was trimmed
+unsigned int *Surface::outlineCanvas(Surface *parent, int levels) {
+	inheritPlacement(parent);
+
+	int w = parent->w();
+	int h = parent->h();
+	int left = std::max(0, std::min(levels, offx));
+	int top = std::max(0, std::min(levels, offy));
+	int right = std::max(0, std::min(levels, fullw - offx - w));
+	int bottom = std::max(0, std::min(levels, fullh - offy - h));
 
-	addOutline(levels, color);
+	width = w + left + right;
+	height = h + top + bottom;
+	offx -= left;
+	offy -= top;
 
-	createSurfaceFromPixelData(w, h);
+	Uint32 *data = new Uint32[width * height];
+	const Uint32 *source = (Uint32 *) parent->pixels();
+	if(width != w || height != h)
+		memset(data, 0, width * height * sizeof(Uint32));
+	for(int y = 0; y < h; y++)
+		memcpy(data + (y + top) * width + left, source + y * w, w * sizeof(Uint32));
+
+	return data;
 }
 
 Surface::Surface(int scaling, Surface *parent) {
@@ -529,28 +797,43 @@ Surface::Surface(int scaling, Surface *parent) {
 	int newh = h * scaling;
 
 	Uint32 *data = new Uint32[neww * newh];
-	Uint32 *pixels = (Uint32 *) parent->pixelData;
-
-	for(int x = 0; x < w; x++) {
-		for(int y = 0; y < h; y++) {
-			Uint32 pixel = pixels[x + y * w];
-			for(int x1 = 0; x1 < scaling; x1++) {
-				for(int y1 = 0; y1 < scaling; y1++) {
-					data[(x * scaling + x1) + (y * scaling + y1) * neww] = pixel;
-				}
-			}
-		}
-	}
+	scaleInteger((Uint32 *) parent->pixels(), w, h, data, scaling);
+
+	offx = parent->offx * scaling;
+	offy = parent->offy * scaling;
+	fullw = parent->fullw * scaling;
+	fullh = parent->fullh * scaling;
 
 	pixelData = (unsigned char *) data;
 	createSurfaceFromPixelData(neww, newh);
 }
 
-Surface::Surface(Surface *parent, std::vector<Color *> colormap) {
+Surface::Surface(Surface *parent, double scaling, ScaleFilter filter) {
 	init();
-	if(!parent->isValid()) return;
+	if(!parent->isValid() || scaling <= 0) return;
+
+	int w = parent->w();
+	int h = parent->h();
+
+	int neww = std::max(1, (int) (w * scaling + 0.5));
+	int newh = std::max(1, (int) (h * scaling + 0.5));
+
+	Uint32 *data = new Uint32[neww * newh];
+	if(filter == SCALE_BILINEAR)
+		scaleBilinear((Uint32 *) parent->pixels(), w, h, data, neww, newh);
+	else
+		scaleNearest((Uint32 *) parent->pixels(), w, h, data, neww, newh);
+
+	offx = (int) (parent->offx * scaling + 0.5);
+	offy = (int) (parent->offy * scaling + 0.5);
+	fullw = (int) (parent->fullw * scaling + 0.5);
+	fullh = (int) (parent->fullh * scaling + 0.5);
+
+	pixelData = (unsigned char *) data;
+	createSurfaceFromPixelData(neww, newh);
+}
 
-	std::map<Uint32, Uint32> map;
+void colorMapFromColors(ColorMap & map, const std::vector<Color *> & colormap) {
 	for(unsigned int i = 0; i + 1 < colormap.size(); i += 2) {
 		Color *from = colormap[i];
 		Color *to = colormap[i+1];
@@ -558,32 +841,38 @@ Surface::Surface(Surface *parent, std::vector<Color *> colormap) {
 		Uint32 fromPx = from->r | (from->g << 8) | (from->b << 16);
 		Uint32 toPx = to->r | (to->g << 8) | (to->b << 16);
 
-		map[fromPx] = toPx;
+		map.add(fromPx, toPx);
 	}
+	map.finish();
+}
+
+Surface::Surface(Surface *parent, std::vector<Color *> colormap) {
+	init();
+	if(!parent->isValid()) return;
+
+	ColorMap map;
+	colorMapFromColors(map, colormap);
 
 	int w = parent->w();
 	int h = parent->h();
 
-	Uint32 *data = new Uint32[w * h];
-	Uint32 *pixels = (Uint32 *) parent->pixelData;
-
-	for(int x = 0; x < w; x++) {
-		for(int y = 0; y < h; y++) {
-			Uint32 pixel = pixels[x + y * w];
-
-			Uint32 color = pixel & 0x00ffffff;
-			auto iter = map.find(color);
-			if(iter != map.end()) {
-				Uint32 alpha = pixel & 0xff000000;
-				data[x + y * w] = iter->second | alpha;
-			} else {
-				data[x + y * w] = pixel;
-			}
-		}
+	PixelBuffer *cached = ColorMapCache::find(parent->hash, w, h, map);
+	if(cached != NULL) {
+		buffer = PixelStore::share(cached);
+		hash = cached->hash;
+		width = w;
+		height = h;
+		inheritPlacement(parent);
+		return;
 	}
 
+	Uint32 *data = new Uint32[w * h];
+	map.apply((Uint32 *) parent->pixels(), data, w * h);
+
+	inheritPlacement(parent);
 	pixelData = (unsigned char *) data;
 	createSurfaceFromPixelData(w, h);
+	ColorMapCache::put(parent->hash, w, h, map, buffer);
 }
 
 Surface::Surface(Surface *parent, Color *color) {
@@ -594,22 +883,9 @@ Surface::Surface(Surface *parent, Color *color) {
 	int h = parent->h();
 
 	Uint32 *data = new Uint32[w * h];
-	Uint32 *pixels = (Uint32 *) parent->pixelData;
-
-	Uint32 rScale = 0x000000ff;
-	Uint32 gScale = 0x0000ff00;
-	Uint32 bScale = 0x00ff0000;
-	for(int x = 0; x < w; x++) {
-		for(int y = 0; y < h; y++) {
-			Uint32 pixel = pixels[x + y * w];
-			Uint32 r = ((pixel & 0x000000ff) * color->r / 0xff) & 0x000000ff;
-			Uint32 g = ((pixel & 0x0000ff00) * color->g / 0xff) & 0x0000ff00;
-			Uint32 b = ((pixel & 0x00ff0000) * color->b / 0xff) & 0x00ff0000;
-			Uint32 a = (((pixel >> 24) & 0x000000ff) * color->a / 0xff) << 24;
-			data[x + y * w] = a | r | g | b;
-		}
-	}
+	multiplyPixels((Uint32 *) parent->pixels(), data, w * h, color->r, color->g, color->b, color->a);
 
+	inheritPlacement(parent);
 	pixelData = (unsigned char *) data;
 	createSurfaceFromPixelData(w, h);
 }
@@ -619,23 +895,104 @@ Surface::Surface(Surface *parent, SurfaceTransform type) {
 	init();
 	if(!parent->isValid()) return;
 
+	if(type == TRIM) {
+		trim(parent);
+		return;
+	}
+
 	int w = parent->w();
 	int h = parent->h();
 
 	Uint32 *data = new Uint32[w * h];
-	Uint32 *pixels = (Uint32 *) parent->pixelData;
-
-	for(int x = 0; x < w; x++) {
-		for(int y = 0; y < h; y++) {
-			Uint32 pixel = pixels[x + y * w];
-			Uint32 r = pixel & 0x000000ff;
-			Uint32 g = (pixel >> 8) & 0x000000ff;
-			Uint32 b = (pixel >> 16) & 0x000000ff;
-			Uint32 gray = (21 * r + 72 * g + 7 * b) / 100;
-			data[x + y * w] = pixel & 0xff000000 | gray | (gray << 8) | (gray << 16);
+	grayscalePixels((Uint32 *) parent->pixels(), data, w * h);
+
+	inheritPlacement(parent);
+	pixelData = (unsigned char *) data;
+	createSurfaceFromPixelData(w, h);
+}
+
+Surface::Surface(Surface *parent, const std::vector<SurfaceStage> & stages) {
+	init();
+	if(!parent->isValid()) return;
+
+	// a trimmed parent is padded for all outlines at once, which is where they'd reach in the untrimmed image
+	int levels = 0;
+	for(const SurfaceStage & stage : stages) {
+		if(stage.type == SurfaceStage::OUTLINE)
+			levels += stage.levels;
+	}
+	unsigned int *canvas = NULL;
+	if(levels > 0) {
+		canvas = outlineCanvas(parent, levels);
+	} else {
+		inheritPlacement(parent);
+		width = parent->w();
+		height = parent->h();
+	}
+
+	int w = width;
+	int h = height;
+
+	Uint32 *data = new Uint32[w * h];
+	const Uint32 *source = canvas != NULL ? canvas : (Uint32 *) parent->pixels();
+
+	// runs of per-pixel stages are applied a row at a time, so each row is read from memory once for all of
+	// them; outlines need the whole image and work in place on the output
+	size_t i = 0;
+	while(i < stages.size()) {
+		size_t end = i;
+		while(end < stages.size() && stages[end].type != SurfaceStage::OUTLINE)
+			end++;
+
+		if(end > i) {
+			for(int y = 0; y < h; y++) {
+				const Uint32 *in = source + y * w;
+				Uint32 *out = data + y * w;
+
+				for(size_t s = i; s < end; s++) {
+					const SurfaceStage & stage = stages[s];
+					switch(stage.type) {
+					case SurfaceStage::GRAYSCALE:
+						grayscalePixels(in, out, w);
+						break;
+					case SurfaceStage::MULTIPLY:
+						multiplyPixels(in, out, w, stage.color.r, stage.color.g, stage.color.b, stage.color.a);
+						break;
+					case SurfaceStage::COLORMAP:
+						stage.colormap->apply(in, out, w);
+						break;
+					default:
+						break;
+					}
+					in = out;
+				}
+			}
+			source = data;
+		}
+
+		if(end < stages.size()) {
+			if(source != data) {
+				memcpy(data, source, w * h * sizeof(Uint32));
+				source = data;
+			}
+
+			const SurfaceStage & stage = stages[end];
+			unsigned int colorValue = (0xff << 24) | (stage.color.b << 16) | (stage.color.g << 8) | (stage.color.r);
+			if(stage.outlineStyle == OUTLINE_ROUND)
+				outlineRound((unsigned char *) data, w, h, stage.levels, colorValue);
+			else
+				outlineSquare((unsigned char *) data, w, h, stage.levels, colorValue);
+
+			end++;
 		}
+
+		i = end;
 	}
 
+	if(source != data)
+		memcpy(data, source, w * h * sizeof(Uint32));
+	delete[] canvas;
+
 	pixelData = (unsigned char *) data;
 	createSurfaceFromPixelData(w, h);
 }
@@ -644,6 +1001,108 @@ Surface::Surface() {
 	init();
 }
 
+Rect Surface::bounds() {
+	int left, top, right, bottom;
+	if(!isValid() || !findBounds((Uint32 *) pixels(), width, height, width, 0xff000000, &left, &top, &right, &bottom))
+		return Rect(0, 0, 0, 0);
+
+	return Rect(left, top, right - left, bottom - top);
+}
+
+bool Surface::save(const std::string & filename) {
+	if(!isValid() || !canEncodeImage(filename)) return false;
+
+	// the encoder gets its own copy, as this surface may be gone before it's done. trimmed surfaces are
+	// saved as the whole image they were cut from, which is what gets drawn
+	const unsigned char *image = pixels();
+	unsigned char *copy = new unsigned char[(size_t) fullw * fullh * 4];
+	if(fullw != width || fullh != height)
+		memset(copy, 0, (size_t) fullw * fullh * 4);
+	for(int y = 0; y < height; y++)
+		memcpy(copy + ((size_t) (offy + y) * fullw + offx) * 4, image + (size_t) y * width * 4, width * 4);
+
+	EncodeQueue::push(filename, copy, fullw, fullh);
+	return true;
+}
+
+void Surface::finishDecode() {
+	// the queue was full when the surface was made
+	if(!pending->queued) {
+		DecodeQueue::push(pending);
+		return;
+	}
+
+	int state = pending->state;
+	if(state == DecodeJob::PENDING) return;
+
+	if(state == DecodeJob::DONE) {
+		pixelData = pending->pixels;
+		pending->pixels = NULL;
+		createSurfaceFromPixelData(pending->width, pending->height, pending->hash, pending->cached);
+	} else {
+		::log("couldn't open picture: %s\n", pending->filename.empty() ? "from blob" : pending->filename.c_str());
+	}
+
+	pending.reset();
+}
+
+Surface::Surface(Surface *parent, Rect *rect) {
+	init();
+	if(!parent->isValid() || rect == NULL) return;
+
+	int x1 = std::max(rect->x, 0);
+	int y1 = std::max(rect->y, 0);
+	int x2 = std::min(rect->x + rect->w, parent->w());
+	int y2 = std::min(rect->y + rect->h, parent->h());
+	if(x2 <= x1 || y2 <= y1) return;
+
+	buffer = parent->buffer;
+	PixelStore::addView(buffer);
+
+	view = true;
+	viewx = parent->viewx + x1;
+	viewy = parent->viewy + y1;
+	width = x2 - x1;
+	height = y2 - y1;
+	fullw = width;
+	fullh = height;
+
+	// hash identifies the pixels in caches, so a part of the buffer can't share the whole buffer's
+	if(width == buffer->width && height == buffer->height) {
+		hash = buffer->hash;
+	} else {
+		unsigned long long key[] = { buffer->hash, (unsigned long long) viewx, (unsigned long long) viewy, (unsigned long long) width, (unsigned long long) height };
+		hash = XXH64(key, sizeof(key), 0);
+	}
+}
+
+void Surface::trim(Surface *parent) {
+	int w = parent->w();
+	int h = parent->h();
+
+	// a fully transparent image keeps a single pixel, as textures can't be empty
+	int left = 0, top = 0, right = 1, bottom = 1;
+	findBounds((Uint32 *) parent->pixels(), w, h, w, 0xff000000, &left, &top, &right, &bottom);
+
+	int neww = right - left;
+	int newh = bottom - top;
+
+	Uint32 *data = new Uint32[neww * newh];
+	const Uint32 *source = (Uint32 *) parent->pixels();
+	for(int y = 0; y < newh; y++)
+		memcpy(data + y * neww, source + (y + top) * w + left, neww * sizeof(Uint32));
+
+	offx = parent->offx + left;
+	offy = parent->offy + top;
+	fullw = parent->fullw;
+	fullh = parent->fullh;
+	padl = parent->padl;
+	padr = parent->padr;
+
+	pixelData = (unsigned char *) data;
+	createSurfaceFromPixelData(neww, newh);
+}
+
 bool Surface::wasDrawn() {
 	auto iter = lastFrameMap.find(hash);
 
@@ -673,8 +1132,9 @@ SurfaceScreenshot::SurfaceScreenshot() {
 	glReadPixels(0, 0, w, h, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
 
 	setBitmap(pixels, 0, 0, w, h, -w * 4);
+	createSurfaceFromPixelData(w, h);
 
-	delete pixels;
+	delete[] pixels;
 };
 
 Screen::Screen() {
@@ -719,10 +1179,36 @@ void Screen::finish() {
 void Screen::blitRect(Surface *src, Rect *srcRect, Rect *destRect, Color *color) {
 	if(!src->isValid()) return;
 
-	int x1 = destRect->x;
-	int y1 = destRect->y;
-	int x2 = destRect->x + destRect->w;
-	int y2 = destRect->y + destRect->h;
+	// part of the image stretched over destRect, in its pixels
+	int sx1 = 0, sy1 = 0, sx2 = src->fullw, sy2 = src->fullh;
+	if(srcRect != NULL) {
+		sx1 = srcRect->x;
+		sy1 = srcRect->y;
+		sx2 = srcRect->x + srcRect->w;
+		sy2 = srcRect->y + srcRect->h;
+	}
+	if(sx2 <= sx1 || sy2 <= sy1) return;
+
+	// a trimmed surface only has pixels for part of the image, the rest is transparent
+	int px1 = std::max(sx1, src->offx);
+	int py1 = std::max(sy1, src->offy);
+	int px2 = std::min(sx2, src->offx + src->width);
+	int py2 = std::min(sy2, src->offy + src->height);
+	if(px2 <= px1 || py2 <= py1) return;
+
+	int x1 = destRect->x + (px1 - sx1) * destRect->w / (sx2 - sx1);
+	int y1 = destRect->y + (py1 - sy1) * destRect->h / (sy2 - sy1);
+	int x2 = destRect->x + (px2 - sx1) * destRect->w / (sx2 - sx1);
+	int y2 = destRect->y + (py2 - sy1) * destRect->h / (sy2 - sy1);
+
+	// the surface's pixels can be a part of a larger texture it shares with others
+	GLuint texture = src->texture();
+	float texw = (float) src->buffer->width;
+	float texh = (float) src->buffer->height;
+	float u1 = (src->viewx + px1 - src->offx) / texw;
+	float v1 = (src->viewy + py1 - src->offy) / texh;
+	float u2 = (src->viewx + px2 - src->offx) / texw;
+	float v2 = (src->viewy + py2 - src->offy) / texh;
 
 	glColor4f( (float)color->r / 0xFF,
 			   (float)color->g / 0xFF,
@@ -730,20 +1216,24 @@ void Screen::blitRect(Surface *src, Rect *srcRect, Rect *destRect, Color *color)
 			   (float)color->a / 0xFF);
 
 	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, src->texture());
+	glBindTexture(GL_TEXTURE_2D, texture);
 
 	glBegin(GL_QUADS);
-	glTexCoord2f(0, 0); glVertex3i(x1, y1, 0);
-	glTexCoord2f(0, 1); glVertex3i(x1, y2, 0);
-	glTexCoord2f(1, 1); glVertex3i(x2, y2, 0);
-	glTexCoord2f(1, 0); glVertex3i(x2, y1, 0);
+	glTexCoord2f(u1, v1); glVertex3i(x1, y1, 0);
+	glTexCoord2f(u1, v2); glVertex3i(x1, y2, 0);
+	glTexCoord2f(u2, v2); glVertex3i(x2, y2, 0);
+	glTexCoord2f(u2, v1); glVertex3i(x2, y1, 0);
 	glEnd();
 }
 
 void Screen::blit(Surface *src, Rect *srcRect, int destx, int desty) {
 	if(!src->isValid()) return;
 
-	Rect destRect = { destx, desty, src->w(), src->h() };
+	Rect destRect = { destx, desty, src->fullw, src->fullh };
+	if(srcRect != NULL) {
+		destRect.w = srcRect->w;
+		destRect.h = srcRect->h;
+	}
 
 	blitRect(src, srcRect, &destRect, &Color::White);
 }
@@ -10,6 +10,9 @@
 #include "Gdiplus.h"
 
 #include "blob.h"
+#include "colormap.h"
+#include "decode.h"
+#include "image-cache.h"
 #include "lua.h"
 
 #include "glew/glew.h"
@@ -29,6 +32,9 @@ struct Color :public SDL_Color {
 	Color(int r, int g, int b);
 };
 
+/// Fills map from a list of colors in pairs: { from1, to1, from2, to2, ... }.
+void colorMapFromColors(ColorMap & map, const std::vector<Color *> & colormap);
+
 struct Rect :public SDL_Rect {
 	Rect(int x, int y, int w, int h);
 	bool contains(int x, int y);
@@ -73,38 +79,134 @@ struct Font {
 struct FileFont :public Font {
 	Gdiplus::PrivateFontCollection privateFontCollection;
 
+	// GDI+ reads memory fonts in place, so the font's bytes have to outlive the blob they came from
+	Blob fontData;
+
 	FileFont(const std::string &filename, double size);
-	FileFont(const Blob *blob, double size);
+	FileFont(Blob *blob, double size);
 
 	void init(double size);
 };
 
 // allows adding more single parameter constructors without worry about too many overloads
-enum SurfaceTransform { GRAYSCALE };
+enum SurfaceTransform { GRAYSCALE, TRIM };
 
-struct Surface {
-	unsigned char *pixelData;
+enum OutlineStyle { OUTLINE_SQUARE, OUTLINE_ROUND };
+
+enum ScaleFilter { SCALE_NEAREST, SCALE_BILINEAR };
+
+// DECODE_ASYNC surfaces are decoded by DecodeQueue and stay invalid until that's done
+enum SurfaceDecode { DECODE_NOW, DECODE_ASYNC };
+
+// one step of a Surface(parent, stages) pipeline, which applies all of them with a single output image
+struct SurfaceStage {
+	enum Type { GRAYSCALE, MULTIPLY, COLORMAP, OUTLINE };
+
+	Type type;
+	Color color;
+	int levels;
+	OutlineStyle outlineStyle;
+	std::shared_ptr<ColorMap> colormap;
+
+	SurfaceStage() {
+		type = GRAYSCALE;
+		levels = 0;
+		outlineStyle = OUTLINE_SQUARE;
+	}
+};
+
+// Pixels of an image along with their texture, shared by all surfaces whose pixels are identical.
+struct PixelBuffer {
+	unsigned char *pixels; // NULL while released, the texture has them then
+	int width, height;
+	unsigned long long hash;
 	GLuint textureId;
+	int refs;
+	int views; // how many of refs didn't save a copy: surfaces showing a part of these pixels, and ColorMapCache
+
+	// set when pixels point into it, like a mapped cache file, instead of being owned by the buffer
+	std::shared_ptr<void> storage;
+};
+
+// Interns pixel buffers by content. Only used from the thread running Lua.
+struct PixelStore {
+	/// Takes ownership of pixels, which must not be modified after that; returns the buffer to use for them.
+	/// If storage is given, pixels belong to it instead, and it is kept as long as they are used.
+	static PixelBuffer *intern(unsigned char *pixels, int w, int h, unsigned long long hash, std::shared_ptr<void> storage = nullptr);
+	/// Returns buffer for another surface with identical pixels, like intern() finding them.
+	static PixelBuffer *share(PixelBuffer *buffer);
+	static void addView(PixelBuffer *buffer);
+	static void release(PixelBuffer *buffer, bool view = false);
+
+	/// References buffer for a cache instead of a surface, until forget() is called.
+	static void hold(PixelBuffer *buffer);
+	static void forget(PixelBuffer *buffer);
+
+	/// Returns pixels of buffer, reading them back from its texture if they were released.
+	static unsigned char *pixels(PixelBuffer *buffer);
+	static GLuint texture(PixelBuffer *buffer);
+
+	/// Frees the copy of pixels in memory once they are in a texture; it is read back when needed.
+	static void releasePixels(PixelBuffer *buffer);
+
+	/// Whether pixels of every buffer are released as soon as they are uploaded to a texture.
+	static bool releaseAfterUpload;
+	static void setReleaseAfterUpload(bool release);
+
+	/// Pushes a table with the number of buffers and of surfaces using them, and bytes held and saved by sharing.
+	static int stats(lua_State *L);
+};
+
+// Recently colormapped images keyed by what they were made from, so applying the same palette swap to
+// the same image again shares the buffer made the first time. Only used from the thread running Lua.
+struct ColorMapCache {
+	/// Returns the buffer of a w * h image made from source pixels with sourceHash, or NULL. The caller has to
+	/// share() it to keep it.
+	static PixelBuffer *find(unsigned long long sourceHash, int w, int h, const ColorMap & map);
+	/// Holds buffer until it is evicted.
+	static void put(unsigned long long sourceHash, int w, int h, const ColorMap & map, PixelBuffer *buffer);
+
+	static size_t capacity; // bytes of buffers held
+};
+
+struct Surface {
+	unsigned char *pixelData; // only while the surface is being made, or a view's copy of its part; use pixels()
+	PixelBuffer *buffer;
+
+	// a view shows the part of buffer at viewx, viewy, width by height pixels, instead of all of it
+	bool view;
+	int viewx, viewy;
 	unsigned long long hash;
 	int width, height;
 	double x, y;
 	int padl, padr;
 
+	// a trimmed surface has pixels of a fullw by fullh image starting at offx, offy; everything else is transparent
+	int offx, offy;
+	int fullw, fullh;
+
+	std::shared_ptr<DecodeJob> pending;
+
+	// setBitmap() only fills pixelData, which createSurfaceFromPixelData() makes the surface's afterwards
 	void setBitmap(Gdiplus::Bitmap *bitmap);
 	void setBitmap(HBITMAP hbitmap, int x, int y, int w, int h);
 	void setBitmap(void *data, int x, int y, int w, int h, int stride);
 	void createSurfaceFromPixelData(int w, int h);
+	void createSurfaceFromPixelData(int w, int h, unsigned long long hash, std::shared_ptr<CachedImage> cached);
 
 	void init();
 	Surface();
-	Surface(const std::string &filename);
-	Surface(Surface *parent, int levels, Color *color);
+	Surface(const std::string &filename, SurfaceDecode decode = DECODE_NOW);
+	Surface(Surface *parent, int levels, Color *color, OutlineStyle style = OUTLINE_SQUARE);
 	Surface(const Font *font, const TextSettings *settings, const std::string &text);
 	Surface(int scaling, Surface *parent);
-	Surface(Blob *blob);
+	Surface(Surface *parent, double scaling, ScaleFilter filter);
+	Surface(Blob *blob, SurfaceDecode decode = DECODE_NOW);
 	Surface(Surface *parent, std::vector<Color *> colormap);
 	Surface(Surface* parent, Color* mask);
 	Surface(Surface* parent, SurfaceTransform type);
+	Surface(Surface *parent, const std::vector<SurfaceStage> & stages);
+	Surface(Surface *parent, Rect *rect);
 
 	int w() {
 		return width;
@@ -122,22 +224,37 @@ struct Surface {
 		return padr;
 	}
 
-	bool wasDrawn();
-
-	GLint texture() {
-		if(textureId == 0 && isValid()) {
-			textureId = glTexture(pixelData, width, height);
-		}
+	int offsetx() {
+		return offx;
+	}
 
-		return textureId;
+	int offsety() {
+		return offy;
 	}
 
+	/// Smallest rectangle holding all pixels that aren't fully transparent.
+	Rect bounds();
+
+	/// Queues the image to be written to a file by EncodeQueue, see encodeImage() for formats. Returns false
+	/// if the surface isn't valid or the format isn't supported.
+	bool save(const std::string & filename);
+
+	bool wasDrawn();
+
+	unsigned char *pixels();
+	GLint texture();
+	void releasePixels();
+
 	~Surface();
 
 	bool isValid();
 
 protected:
-	void addOutline(int levels, const Color *color);
+	void finishDecode();
+	void inheritPlacement(Surface *parent);
+	unsigned int *outlineCanvas(Surface *parent, int levels);
+	void trim(Surface *parent);
+	void addOutline(int levels, const Color *color, OutlineStyle style = OUTLINE_SQUARE);
 };
 static std::vector<Color *> testMap() {
 	std::vector<Color *> list;
@@ -0,0 +1,83 @@
+#include "swizzle.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+static void swizzleRowScalar(unsigned char *dst, const unsigned char *src, int pixels) {
+	for(int x = 0; x < pixels; x++) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = src[3];
+
+		dst += 4;
+		src += 4;
+	}
+}
+
+// SSE2 has no byte shuffle, so red and blue are moved with shifts within each 32 bit pixel
+static void swizzleRowSse2(unsigned char *dst, const unsigned char *src, int pixels) {
+	const __m128i keep = _mm_set1_epi32(0xff00ff00);
+	const __m128i low = _mm_set1_epi32(0x000000ff);
+
+	int x = 0;
+	for(; x + 4 <= pixels; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + x * 4));
+		__m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+		__m128i b = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+		v = _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(r, b));
+		_mm_storeu_si128((__m128i *) (dst + x * 4), v);
+	}
+
+	swizzleRowScalar(dst + x * 4, src + x * 4, pixels - x);
+}
+
+static void swizzleRowAvx2(unsigned char *dst, const unsigned char *src, int pixels) {
+	const __m256i order = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	int x = 0;
+	for(; x + 8 <= pixels; x += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (src + x * 4));
+		_mm256_storeu_si256((__m256i *) (dst + x * 4), _mm256_shuffle_epi8(v, order));
+	}
+
+	swizzleRowSse2(dst + x * 4, src + x * 4, pixels - x);
+}
+
+static bool cpuHasAvx2() {
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return false;
+
+	// the OS has to save ymm registers on context switches, or using them corrupts other threads
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if(!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+}
+
+typedef void (*SwizzleRowFunction)(unsigned char *dst, const unsigned char *src, int pixels);
+
+static SwizzleRowFunction selectSwizzleRow() {
+	int info[4];
+	__cpuid(info, 1);
+	if((info[3] & (1 << 26)) == 0) return swizzleRowScalar;
+
+	if(cpuHasAvx2()) return swizzleRowAvx2;
+	return swizzleRowSse2;
+}
+
+void swizzleRow(unsigned char *dst, const unsigned char *src, int pixels) {
+	static const SwizzleRowFunction function = selectSwizzleRow();
+
+	function(dst, src, pixels);
+}
+
+void swizzleRows(unsigned char *dst, const unsigned char *src, int w, int h, int stride) {
+	for(int y = 0; y < h; y++)
+		swizzleRow(dst + y * w * 4, src + y * stride, w);
+}
@@ -0,0 +1,12 @@
+#ifndef __SWIZZLE_H__
+#define __SWIZZLE_H__
+
+/// Copies a row of 32 bit pixels swapping the first and third byte of each, which converts between
+/// BGRA (GDI, GDI+) and RGBA (OpenGL) in either direction. Uses AVX2 or SSE2 depending on the CPU.
+void swizzleRow(unsigned char *dst, const unsigned char *src, int pixels);
+
+/// Swizzles a w x h block. Rows are stride bytes apart in src; a negative stride means the source
+/// is stored bottom-up and the copy flips it.
+void swizzleRows(unsigned char *dst, const unsigned char *src, int w, int h, int stride);
+
+#endif
@@ -0,0 +1,103 @@
+// Measures palette swaps with the std::map loop sdl.colormapped used before colormap.cc and with
+// ColorMap::apply, for a small map (one collision-free table) and a large one (linear probing).
+// From the repository root:
+//
+//   cl /O2 /EHsc tools\colormap-bench.cc colormap.cc xxhash.c
+//   g++ -O2 -o colormap-bench tools/colormap-bench.cc colormap.cc -x c xxhash.c
+//
+// colormap-bench [width height]  swaps colors of a width x height sprite (default 120x120) and checks
+//                                ColorMap still matches the old loop
+
+#include "../colormap.h"
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include <chrono>
+
+static void oldColormap(const unsigned int *pixels, unsigned int *data, int w, int h, const std::map<unsigned int, unsigned int> & map) {
+	for(int x = 0; x < w; x++) {
+		for(int y = 0; y < h; y++) {
+			unsigned int pixel = pixels[x + y * w];
+
+			unsigned int color = pixel & 0x00ffffff;
+			auto iter = map.find(color);
+			if(iter != map.end()) {
+				unsigned int alpha = pixel & 0xff000000;
+				data[x + y * w] = iter->second | alpha;
+			} else {
+				data[x + y * w] = pixel;
+			}
+		}
+	}
+}
+
+// microseconds per run, repeated for at least a tenth of a second to even out the clock's resolution
+template<typename Run> static double timeRuns(Run run) {
+	typedef std::chrono::steady_clock Clock;
+
+	int runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed;
+	do {
+		run();
+
+		runs++;
+		elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	} while(elapsed < 100000);
+
+	return elapsed / runs;
+}
+
+// a sprite drawn with a palette: stretches of one color, some of them transparent
+static std::vector<unsigned int> spriteImage(int w, int h, const std::vector<unsigned int> & palette) {
+	std::vector<unsigned int> pixels((size_t) w * h);
+	for(int y = 0; y < h; y++) {
+		for(int x = 0; x < w; x++) {
+			unsigned int color = palette[((x / 5) * 7 + (y / 3) * 3) % palette.size()];
+			unsigned int alpha = (x + y) % 11 == 0 ? 0 : 0xff000000;
+			pixels[(size_t) y * w + x] = color | alpha;
+		}
+	}
+	return pixels;
+}
+
+static bool measure(int w, int h, int colors) {
+	// maps every second color of the palette, so lookups both hit and miss
+	std::vector<unsigned int> palette;
+	for(int i = 0; i < colors * 2; i++)
+		palette.push_back(((unsigned int) i * 2654435761u) & 0x00ffffff);
+
+	std::map<unsigned int, unsigned int> oldMap;
+	ColorMap map;
+	for(int i = 0; i < colors; i++) {
+		unsigned int from = palette[i * 2], to = palette[i * 2] ^ 0x00808080;
+		oldMap[from] = to;
+		map.add(from, to);
+	}
+	map.finish();
+
+	std::vector<unsigned int> source = spriteImage(w, h, palette);
+	std::vector<unsigned int> before(source.size()), after(source.size());
+	double oldTime = timeRuns([&] { oldColormap(source.data(), before.data(), w, h, oldMap); });
+	double newTime = timeRuns([&] { map.apply(source.data(), after.data(), w * h); });
+
+	bool same = before == after;
+	printf("%dx%d, %d colors: old loop %.1fus, ColorMap %.1fus, %.1fx%s\n",
+		w, h, colors, oldTime, newTime, oldTime / newTime, same ? "" : ", OUTPUT DIFFERS");
+	return same;
+}
+
+int main(int argc, char **argv) {
+	int w = argc > 2 ? atoi(argv[1]) : 120;
+	int h = argc > 2 ? atoi(argv[2]) : 120;
+	if(w < 1 || h < 1) {
+		fprintf(stderr, "usage: %s [width height]\n", argv[0]);
+		return 2;
+	}
+
+	bool ok = measure(w, h, 8);
+	ok = measure(w, h, 64) && ok;
+
+	return ok ? 0 : 1;
+}
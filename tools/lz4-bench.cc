@@ -0,0 +1,86 @@
+// Measures how well lz4.cc compresses files and how fast it decompresses them, to judge which archive
+// entries are worth storing compressed with sdl.resourceDatWriter. From the repository root:
+//
+//   cl /O2 /EHsc tools\lz4-bench.cc lz4.cc
+//   g++ -O2 -o lz4-bench tools/lz4-bench.cc lz4.cc
+//
+// lz4-bench file...  prints compressed size and decompression speed of every file, and checks the round trip
+
+#include "../lz4.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <chrono>
+
+static bool readFile(const char *filename, std::vector<unsigned char> & contents) {
+	FILE *file = fopen(filename, "rb");
+	if(file == NULL) return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	bool ok = size > 0;
+	if(ok) {
+		contents.resize(size);
+		ok = fread(contents.data(), 1, size, file) == (size_t) size;
+	}
+
+	fclose(file);
+	return ok;
+}
+
+// microseconds per run, repeated for at least a tenth of a second to even out the clock's resolution
+template<typename Run> static double timeRuns(Run run) {
+	typedef std::chrono::steady_clock Clock;
+
+	int runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed;
+	do {
+		run();
+
+		runs++;
+		elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	} while(elapsed < 100000);
+
+	return elapsed / runs;
+}
+
+static bool measure(const char *filename) {
+	std::vector<unsigned char> source;
+	if(!readFile(filename, source)) {
+		fprintf(stderr, "%s: can't read\n", filename);
+		return false;
+	}
+
+	int size = (int) source.size();
+	std::vector<unsigned char> compressed(lz4CompressBound(size));
+	int compressedSize = lz4Compress(source.data(), size, compressed.data(), (int) compressed.size());
+
+	std::vector<unsigned char> decompressed(size);
+	double decompressTime = timeRuns([&] { lz4Decompress(compressed.data(), compressedSize, decompressed.data(), size); });
+	double copyTime = timeRuns([&] { memcpy(decompressed.data(), source.data(), size); });
+
+	if(lz4Decompress(compressed.data(), compressedSize, decompressed.data(), size) != size || decompressed != source) {
+		fprintf(stderr, "%s: round trip failed\n", filename);
+		return false;
+	}
+
+	printf("%s: %d bytes, ratio %.2f, decompress %.0f MB/s, memcpy %.0f MB/s\n",
+		filename, size, (double) compressedSize / size, size / decompressTime, size / copyTime);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s file...\n", argv[0]);
+		return 2;
+	}
+
+	bool ok = true;
+	for(int i = 1; i < argc; i++)
+		ok = measure(argv[i]) && ok;
+
+	return ok ? 0 : 1;
+}
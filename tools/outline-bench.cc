@@ -0,0 +1,142 @@
+// Measures outlining with the per-level dilation Surface::addOutline used before outline.cc, and with
+// outlineSquare and outlineRound, at a few widths. From the repository root:
+//
+//   cl /O2 /EHsc tools\outline-bench.cc outline.cc
+//   g++ -O2 -o outline-bench tools/outline-bench.cc outline.cc
+//
+// outline-bench  prints microseconds per call for a line of text and a sprite, and checks the square
+//                outline still matches the old one
+
+#include "../outline.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <chrono>
+
+static void oldOutline(unsigned char *pixelData, int w, int h, int levels, unsigned int colorValue) {
+	unsigned char *data = new unsigned char[w * h * 4];
+	unsigned char *data2 = new unsigned char[w * h * 4];
+
+	memcpy(data, pixelData, 4 * w * h);
+
+	for(int i = 0; i < levels; i++) {
+		memcpy(data2, data, 4 * w * h);
+
+		for(int y = 0; y < h; y++) {
+			for(int x = 0; x < w; x++) {
+				unsigned char *p = &data[(x + y * w) * 4];
+				unsigned char *p2 = &data2[(x + y * w) * 4];
+				if(p[3] > 128) {
+					if(x > 0 && p[-1] < 128)    ((int *) p2)[-1] = colorValue;
+					if(x + 1 < w && p[7] < 128) ((int *) p2)[+1] = colorValue;
+				}
+			}
+		}
+
+		memcpy(data, data2, 4 * w * h);
+
+		for(int y = 0; y < h; y++) {
+			for(int x = 0; x < w; x++) {
+				unsigned char *p = &data[(x + y * w) * 4];
+				unsigned char *p2 = &data2[(x + y * w) * 4];
+				if(p[3] > 128) {
+					if(y > 0 && p[-w * 4 + 3] < 128)    ((int *) p2)[-w] = colorValue;
+					if(y + 1 < h && p[w * 4 + 3] < 128) ((int *) p2)[+w] = colorValue;
+				}
+			}
+		}
+
+		unsigned char *tmp = data;
+		data = data2;
+		data2 = tmp;
+	}
+
+	memcpy(pixelData, data, 4 * w * h);
+
+	delete[] data;
+	delete[] data2;
+}
+
+// microseconds per call, repeated for at least a tenth of a second; every call outlines a fresh copy
+template<typename Outline> static double timeOutline(const std::vector<unsigned char> & image, Outline outline) {
+	typedef std::chrono::steady_clock Clock;
+
+	std::vector<unsigned char> pixels;
+	double total = 0;
+	int runs = 0;
+	do {
+		pixels = image;
+
+		Clock::time_point start = Clock::now();
+		outline(pixels.data());
+		total += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+		runs++;
+	} while(total < 100000);
+
+	return total / runs;
+}
+
+// text: short strokes of opaque pixels with gaps, like glyphs rendered in a row
+static std::vector<unsigned char> textImage(int w, int h) {
+	std::vector<unsigned char> pixels((size_t) w * h * 4, 0);
+	for(int y = 4; y < h - 4; y++) {
+		for(int x = 0; x < w; x++) {
+			int column = x % 12;
+			bool stroke = column < 2 || (column < 8 && (y == 4 || y == h / 2 || y == h - 5));
+			if(stroke) {
+				unsigned char *p = &pixels[((size_t) y * w + x) * 4];
+				p[0] = 255;
+				p[3] = 255;
+			}
+		}
+	}
+	return pixels;
+}
+
+// sprite: a filled disc in the middle with transparent corners
+static std::vector<unsigned char> spriteImage(int w, int h) {
+	std::vector<unsigned char> pixels((size_t) w * h * 4, 0);
+	int r = w * 3 / 8;
+	for(int y = 0; y < h; y++) {
+		for(int x = 0; x < w; x++) {
+			int dx = x - w / 2, dy = y - h / 2;
+			if(dx * dx + dy * dy <= r * r) {
+				unsigned char *p = &pixels[((size_t) y * w + x) * 4];
+				p[1] = 200;
+				p[3] = 255;
+			}
+		}
+	}
+	return pixels;
+}
+
+static bool measure(const char *name, const std::vector<unsigned char> & image, int w, int h) {
+	const unsigned int color = 0xff000000;
+	bool same = true;
+
+	printf("%s %dx%d, us per call (old / square / round):", name, w, h);
+	for(int levels : { 1, 2, 3, 4, 8 }) {
+		double oldTime = timeOutline(image, [&](unsigned char *p) { oldOutline(p, w, h, levels, color); });
+		double squareTime = timeOutline(image, [&](unsigned char *p) { outlineSquare(p, w, h, levels, color); });
+		double roundTime = timeOutline(image, [&](unsigned char *p) { outlineRound(p, w, h, levels, color); });
+		printf("  w%d %.0f/%.0f/%.0f", levels, oldTime, squareTime, roundTime);
+
+		std::vector<unsigned char> before = image, after = image;
+		oldOutline(before.data(), w, h, levels, color);
+		outlineSquare(after.data(), w, h, levels, color);
+		if(before != after) {
+			printf(" (square differs from old)");
+			same = false;
+		}
+	}
+	printf("\n");
+
+	return same;
+}
+
+int main() {
+	bool ok = measure("text", textImage(600, 24), 600, 24);
+	ok = measure("sprite", spriteImage(64, 64), 64, 64) && ok;
+
+	return ok ? 0 : 1;
+}
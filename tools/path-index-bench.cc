@@ -0,0 +1,78 @@
+// Measures building a ResourceDatFile index and looking names up in it, with the std::map the index used
+// to be and with PathIndex. From the repository root:
+//
+//   cl /O2 /EHsc tools\path-index-bench.cc
+//   g++ -O2 -o path-index-bench tools/path-index-bench.cc
+//
+// path-index-bench [count]  indexes count names (default 10000), then looks each one up once
+
+#include "../path-index.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+
+// milliseconds per run, repeated for at least a tenth of a second to even out the clock's resolution
+template<typename Run> static double timeRuns(Run run) {
+	typedef std::chrono::steady_clock Clock;
+
+	int runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed;
+	do {
+		run();
+
+		runs++;
+		elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	} while(elapsed < 100);
+
+	return elapsed / runs;
+}
+
+int main(int argc, char **argv) {
+	int count = argc > 1 ? atoi(argv[1]) : 10000;
+	if(count < 1) {
+		fprintf(stderr, "usage: %s [count]\n", argv[0]);
+		return 2;
+	}
+
+	// names like the game's own, lowercase with forward slashes so both indexes see the same keys
+	std::vector<std::string> names;
+	size_t poolSize = 0;
+	for(int i = 0; i < count; i++) {
+		char name[64];
+		sprintf(name, "img/units/player/mech_%05d_anim.png", i);
+		names.push_back(name);
+		poolSize += names.back().size();
+	}
+
+	// lookups in an order unrelated to insertion, so nothing stays in cache by accident
+	std::vector<int> order(count);
+	for(int i = 0; i < count; i++)
+		order[i] = (int) ((i * 7919ull) % count);
+
+	volatile size_t sink = 0;
+
+	double mapTime = timeRuns([&] {
+		std::map<std::string, size_t> index;
+		for(int i = 0; i < count; i++)
+			index[names[i]] = i;
+		for(int i : order)
+			sink += index.find(names[i])->second;
+	});
+
+	double pathIndexTime = timeRuns([&] {
+		PathIndex<size_t> index;
+		index.reserve(count, poolSize);
+		for(int i = 0; i < count; i++)
+			index.insert(names[i], i);
+		for(int i : order)
+			sink += *index.find(names[i]);
+	});
+
+	printf("%d names, build and look up each: std::map %.2fms, PathIndex %.2fms, %.1fx\n",
+		count, mapTime, pathIndexTime, mapTime / pathIndexTime);
+	return 0;
+}
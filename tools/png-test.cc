@@ -0,0 +1,194 @@
+// Checks the PNG encoder and decoder and the deflate and inflate code under them against each other:
+// random data split into pieces inflates back to itself, random images encoded with any number of bands
+// decode back to themselves, and truncated or corrupted files are rejected or decoded without reading or
+// writing out of bounds. From the repository root:
+//
+//   cl /O2 /EHsc tools\png-test.cc png-encode.cc png-decode.cc deflate.cc inflate.cc
+//   g++ -O2 -pthread -o png-test tools/png-test.cc png-encode.cc png-decode.cc deflate.cc inflate.cc
+//
+// Out of bounds accesses only show up with a checker, e.g. g++ -fsanitize=address or cl /fsanitize=address.
+// Both coders use SSE2 when the compiler targets it; a 32 bit build without it tests the scalar code.
+// Prints every failed check and exits with 1 if there was one.
+
+#include "../png-encode.h"
+#include "../png-decode.h"
+#include "../deflate.h"
+#include "../inflate.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <random>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+	if(!ok) {
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+// bytes with repeats at every distance deflate looks at, mixed with noise
+static std::vector<unsigned char> randomData(std::mt19937 & random, size_t size) {
+	std::vector<unsigned char> data(size);
+	int alphabet = 1 + random() % 64;
+
+	for(size_t i = 0; i < size; i++) {
+		if(i > 0 && random() % 3 == 0) {
+			size_t distance = 1 + random() % (i < 40000 ? i : 40000);
+			data[i] = data[i - distance];
+		} else {
+			data[i] = (unsigned char) (random() % alphabet);
+		}
+	}
+
+	return data;
+}
+
+// a zlib stream of data deflated in pieces, the way png-encode.cc joins its bands
+static std::vector<unsigned char> deflateInPieces(std::mt19937 & random, const std::vector<unsigned char> & data) {
+	std::vector<unsigned char> stream = { 0x78, 0x01 };
+
+	int pieces = 1 + random() % 4;
+	size_t start = 0;
+	unsigned int adler = 1;
+	for(int i = 0; i < pieces; i++) {
+		size_t end = i + 1 == pieces ? data.size() : start + random() % (data.size() - start + 1);
+		deflatePiece(data.data() + start, end - start, i + 1 == pieces, stream);
+
+		adler = i == 0 ? adler32(data.data(), end) : adler32Combine(adler, adler32(data.data() + start, end - start), end - start);
+		start = end;
+	}
+
+	for(int shift = 24; shift >= 0; shift -= 8)
+		stream.push_back((unsigned char) (adler >> shift));
+
+	check(adler == adler32(data.data(), data.size()), "combined adler32 matches the whole data's");
+	return stream;
+}
+
+static void testDeflate() {
+	std::mt19937 random(1);
+	int failed = 0;
+
+	for(int i = 0; i < 3000; i++) {
+		std::vector<unsigned char> data = randomData(random, random() % 100000);
+		std::vector<unsigned char> stream = deflateInPieces(random, data);
+
+		std::vector<unsigned char> inflated(data.size() + 1);
+		long long size = zlibDecompress(stream.data(), stream.size(), inflated.data(), inflated.size());
+		if(size != (long long) data.size() || memcmp(inflated.data(), data.data(), data.size()) != 0)
+			failed++;
+	}
+
+	check(failed == 0, "data deflated in pieces inflates to itself");
+}
+
+// random images made of runs, small steps and jumps, opaque or not
+static std::vector<unsigned char> randomImage(std::mt19937 & random, int w, int h) {
+	std::vector<unsigned char> pixels((size_t) w * h * 4);
+	unsigned char pixel[4] = { 0, 0, 0, 255 };
+	bool opaque = random() % 2 == 0;
+
+	for(size_t i = 0; i < pixels.size(); i += 4) {
+		switch(random() % 4) {
+		case 0:
+			break;
+		case 1:
+			for(int c = 0; c < 4; c++) pixel[c] += (unsigned char) (random() % 5) - 2;
+			break;
+		case 2:
+			if(i >= (size_t) w * 4) memcpy(pixel, &pixels[i - w * 4], 4);
+			break;
+		default:
+			for(int c = 0; c < 4; c++) pixel[c] = (unsigned char) random();
+			break;
+		}
+		if(opaque) pixel[3] = 255;
+
+		memcpy(&pixels[i], pixel, 4);
+	}
+
+	return pixels;
+}
+
+static bool roundTrips(const std::vector<unsigned char> & pixels, int w, int h, int threads) {
+	std::vector<unsigned char> png;
+	pngEncode(pixels.data(), w, h, threads, png);
+
+	int decodedw = 0, decodedh = 0;
+	unsigned char *decoded = pngDecode(png.data(), png.size(), &decodedw, &decodedh);
+	if(decoded == NULL) return false;
+
+	bool ok = decodedw == w && decodedh == h && memcmp(decoded, pixels.data(), pixels.size()) == 0;
+	delete[] decoded;
+	return ok;
+}
+
+static void testPng() {
+	std::mt19937 random(2);
+	int failed = 0;
+
+	for(int i = 0; i < 400; i++) {
+		int w = 1 + random() % 96, h = 1 + random() % 96;
+		if(!roundTrips(randomImage(random, w, h), w, h, 1 + random() % 8)) failed++;
+	}
+	check(failed == 0, "random images decode to themselves");
+
+	// bands are at least 256 KB, so only images this large are cut into several
+	failed = 0;
+	for(int threads = 1; threads <= 8; threads++) {
+		int w = 700, h = 400 + threads * 50;
+		if(!roundTrips(randomImage(random, w, h), w, h, threads)) failed++;
+	}
+	check(failed == 0, "images encoded in several bands decode to themselves");
+}
+
+// only checks the decoders return; a checker reports any out of bounds access on the way
+static void testCorrupted() {
+	std::mt19937 random(3);
+
+	for(int i = 0; i < 2000; i++) {
+		int w = 1 + random() % 32, h = 1 + random() % 32;
+		std::vector<unsigned char> pixels = randomImage(random, w, h);
+
+		std::vector<unsigned char> png;
+		pngEncode(pixels.data(), w, h, 1, png);
+
+		if(random() % 2 == 0) {
+			png.resize(random() % png.size());
+		} else {
+			for(int n = 1 + random() % 4; n > 0; n--)
+				png[random() % png.size()] ^= (unsigned char) (1 + random() % 255);
+		}
+
+		int decodedw, decodedh;
+		delete[] pngDecode(png.data(), png.size(), &decodedw, &decodedh);
+	}
+
+	for(int i = 0; i < 2000; i++) {
+		std::vector<unsigned char> data = randomData(random, random() % 5000);
+		std::vector<unsigned char> stream = deflateInPieces(random, data);
+
+		if(random() % 2 == 0) {
+			stream.resize(random() % stream.size());
+		} else {
+			for(int n = 1 + random() % 4; n > 0; n--)
+				stream[random() % stream.size()] ^= (unsigned char) (1 + random() % 255);
+		}
+
+		std::vector<unsigned char> inflated(data.size());
+		zlibDecompress(stream.data(), stream.size(), inflated.data(), inflated.size());
+	}
+}
+
+int main() {
+	testDeflate();
+	testPng();
+	testCorrupted();
+
+	if(failures == 0)
+		printf("all passed\n");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+// Converts PNG images to QOI, which sdl.surface and sdl.surfaceFromBlob load faster, and measures how much
+// faster. Uses the library's own decoders, so it doesn't need anything but a C++ compiler. From the
+// repository root:
+//
+//   cl /O2 /EHsc tools\qoi-convert.cc png-decode.cc inflate.cc qoi.cc
+//   g++ -O2 -o qoi-convert tools/qoi-convert.cc png-decode.cc inflate.cc qoi.cc
+//
+// qoi-convert image.png...          writes image.qoi next to every image
+// qoi-convert --bench image.png...  decodes every image as PNG and as QOI and prints the times
+
+#include "../png-decode.h"
+#include "../qoi.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+
+static bool readFile(const char *filename, std::vector<unsigned char> & contents) {
+	FILE *file = fopen(filename, "rb");
+	if(file == NULL) return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	bool ok = size > 0;
+	if(ok) {
+		contents.resize(size);
+		ok = fread(contents.data(), 1, size, file) == (size_t) size;
+	}
+
+	fclose(file);
+	return ok;
+}
+
+static bool writeFile(const std::string & filename, const unsigned char *data, size_t size) {
+	FILE *file = fopen(filename.c_str(), "wb");
+	if(file == NULL) return false;
+
+	bool ok = fwrite(data, 1, size, file) == size;
+	return fclose(file) == 0 && ok;
+}
+
+static std::string qoiName(const std::string & filename) {
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of("/\\");
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return filename + ".qoi";
+
+	return filename.substr(0, dot) + ".qoi";
+}
+
+// microseconds per decode, repeated for at least a tenth of a second to even out the clock's resolution
+template<typename Decode> static double timeDecode(Decode decode) {
+	typedef std::chrono::steady_clock Clock;
+
+	int runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed;
+	do {
+		int w, h;
+		unsigned char *pixels = decode(&w, &h);
+		delete[] pixels;
+
+		runs++;
+		elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	} while(elapsed < 100000);
+
+	return elapsed / runs;
+}
+
+static bool convert(const char *filename, bool bench, double *pngTotal, double *qoiTotal) {
+	std::vector<unsigned char> png;
+	if(!readFile(filename, png)) {
+		fprintf(stderr, "%s: can't read\n", filename);
+		return false;
+	}
+
+	int w, h;
+	unsigned char *pixels = pngSignature(png.data(), png.size()) ? pngDecode(png.data(), png.size(), &w, &h) : NULL;
+	if(pixels == NULL) {
+		fprintf(stderr, "%s: not a PNG the library can decode itself\n", filename);
+		return false;
+	}
+
+	size_t size;
+	unsigned char *qoi = qoiEncode(pixels, w, h, &size);
+	delete[] pixels;
+
+	bool ok = true;
+	if(bench) {
+		double pngTime = timeDecode([&png](int *w, int *h) { return pngDecode(png.data(), png.size(), w, h); });
+		double qoiTime = timeDecode([qoi, size](int *w, int *h) { return qoiDecode(qoi, size, w, h); });
+		*pngTotal += pngTime;
+		*qoiTotal += qoiTime;
+
+		printf("%s: %dx%d, PNG %zu bytes %.1fus, QOI %zu bytes %.1fus, %.1fx\n",
+			filename, w, h, png.size(), pngTime, size, qoiTime, pngTime / qoiTime);
+	} else {
+		std::string out = qoiName(filename);
+		ok = writeFile(out, qoi, size);
+		if(!ok) fprintf(stderr, "%s: can't write\n", out.c_str());
+	}
+
+	delete[] qoi;
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+	int first = bench ? 2 : 1;
+	if(first >= argc) {
+		fprintf(stderr, "usage: %s [--bench] image.png...\n", argv[0]);
+		return 2;
+	}
+
+	bool ok = true;
+	double pngTotal = 0, qoiTotal = 0;
+	for(int i = first; i < argc; i++)
+		ok = convert(argv[i], bench, &pngTotal, &qoiTotal) && ok;
+
+	if(bench && qoiTotal > 0)
+		printf("total: PNG %.1fus, QOI %.1fus, %.1fx\n", pngTotal, qoiTotal, pngTotal / qoiTotal);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+// Checks the QOI decoder against hand-made streams, including codes other encoders emit but qoiEncode()
+// doesn't, that random images decode back to themselves, and that truncated or corrupted files are
+// rejected or decoded without reading or writing out of bounds. From the repository root:
+//
+//   cl /EHsc tools\qoi-test.cc qoi.cc
+//   g++ -o qoi-test tools/qoi-test.cc qoi.cc
+//
+// Out of bounds accesses only show up with a checker, e.g. g++ -fsanitize=address or cl /fsanitize=address.
+// Prints every failed check and exits with 1 if there was one.
+
+#include "../qoi.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <random>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+	if(!ok) {
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+// header of a 4 channel w * h image, followed by codes and the end marker
+static std::vector<unsigned char> stream(int w, int h, const std::vector<unsigned char> & codes) {
+	std::vector<unsigned char> data = { 'q', 'o', 'i', 'f', 0, 0, 0, (unsigned char) w, 0, 0, 0, (unsigned char) h, 4, 0 };
+	data.insert(data.end(), codes.begin(), codes.end());
+	data.insert(data.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+	return data;
+}
+
+static bool decodesTo(const std::vector<unsigned char> & data, int w, int h, const std::vector<unsigned char> & expected) {
+	int decodedw = 0, decodedh = 0;
+	unsigned char *pixels = qoiDecode(data.data(), data.size(), &decodedw, &decodedh);
+	if(pixels == NULL) return false;
+
+	bool ok = decodedw == w && decodedh == h && memcmp(pixels, expected.data(), expected.size()) == 0;
+	delete[] pixels;
+	return ok;
+}
+
+static void testRunThenIndex() {
+	// a run of the initial color puts it into the index, at 53 for (0, 0, 0, 255); then a different
+	// color, then index 53 brings the initial color back
+	std::vector<unsigned char> data = stream(4, 1, { 0xc0 | 1, 0xfe, 10, 20, 30, 0x00 | 53, 0x00 | 53 });
+	check(decodesTo(data, 4, 1, { 0, 0, 0, 255, 0, 0, 0, 255, 10, 20, 30, 255, 0, 0, 0, 255 }), "index of a color only seen in a run");
+}
+
+static void testRoundTrip() {
+	const int w = 37, h = 11;
+	std::vector<unsigned char> pixels(w * h * 4);
+	for(int i = 0; i < w * h; i++) {
+		// stretches of equal pixels, small steps and jumps, so every kind of code is used
+		int v = i / 5;
+		pixels[i * 4 + 0] = (unsigned char) (v * 3);
+		pixels[i * 4 + 1] = (unsigned char) (i % 7 == 0 ? v * 91 : v);
+		pixels[i * 4 + 2] = (unsigned char) (v * v);
+		pixels[i * 4 + 3] = (unsigned char) (i % 13 == 0 ? 128 : 255);
+	}
+
+	size_t size = 0;
+	unsigned char *encoded = qoiEncode(pixels.data(), w, h, &size);
+	std::vector<unsigned char> data(encoded, encoded + size);
+	delete[] encoded;
+
+	check(qoiSignature(data.data(), data.size()), "signature of an encoded image");
+	check(decodesTo(data, w, h, pixels), "encoded image decodes to itself");
+}
+
+static void testMalformed() {
+	int w, h;
+	std::vector<unsigned char> truncated = stream(4, 1, { 0xc0 | 1 });
+	check(qoiDecode(truncated.data(), truncated.size(), &w, &h) == NULL, "stream with too few pixels is rejected");
+}
+
+// random images made of runs, small steps, repeats of earlier colors and jumps, in every mix
+static std::vector<unsigned char> randomImage(std::mt19937 & random, int w, int h) {
+	std::vector<unsigned char> pixels((size_t) w * h * 4);
+	std::vector<unsigned char> seen(4 * 8, 255);
+	unsigned char pixel[4] = { 0, 0, 0, 255 };
+	bool opaque = random() % 2 == 0;
+
+	for(size_t i = 0; i < pixels.size(); i += 4) {
+		switch(random() % 5) {
+		case 0: // same as the previous pixel
+			break;
+		case 1: // small step
+			for(int c = 0; c < 3; c++) pixel[c] += (unsigned char) (random() % 5) - 2;
+			break;
+		case 2: // one of a few colors used before
+			memcpy(pixel, &seen[(random() % 8) * 4], 4);
+			break;
+		default:
+			for(int c = 0; c < 4; c++) pixel[c] = (unsigned char) random();
+			break;
+		}
+		if(opaque) pixel[3] = 255;
+
+		memcpy(&pixels[i], pixel, 4);
+		memcpy(&seen[(random() % 8) * 4], pixel, 4);
+	}
+
+	return pixels;
+}
+
+static void testRandomRoundTrips() {
+	std::mt19937 random(1);
+	int failed = 0;
+
+	for(int i = 0; i < 800; i++) {
+		int w = 1 + random() % 64, h = 1 + random() % 64;
+		std::vector<unsigned char> pixels = randomImage(random, w, h);
+
+		size_t size = 0;
+		unsigned char *encoded = qoiEncode(pixels.data(), w, h, &size);
+		std::vector<unsigned char> data(encoded, encoded + size);
+		delete[] encoded;
+
+		if(!decodesTo(data, w, h, pixels)) failed++;
+	}
+
+	check(failed == 0, "random images decode to themselves");
+}
+
+// only checks the decoder returns; a checker reports any out of bounds access on the way
+static void testCorrupted() {
+	std::mt19937 random(2);
+
+	for(int i = 0; i < 2000; i++) {
+		int w = 1 + random() % 16, h = 1 + random() % 16;
+		std::vector<unsigned char> pixels = randomImage(random, w, h);
+
+		size_t size = 0;
+		unsigned char *encoded = qoiEncode(pixels.data(), w, h, &size);
+		std::vector<unsigned char> data(encoded, encoded + size);
+		delete[] encoded;
+
+		if(random() % 2 == 0) {
+			data.resize(random() % data.size());
+		} else {
+			for(int n = 1 + random() % 4; n > 0; n--)
+				data[random() % data.size()] ^= (unsigned char) (1 + random() % 255);
+		}
+
+		int decodedw, decodedh;
+		delete[] qoiDecode(data.data(), data.size(), &decodedw, &decodedh);
+	}
+}
+
+int main() {
+	testRunThenIndex();
+	testRoundTrip();
+	testMalformed();
+	testRandomRoundTrips();
+	testCorrupted();
+
+	if(failures == 0)
+		printf("all passed\n");
+
+	return failures == 0 ? 0 : 1;
+}
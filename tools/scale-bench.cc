@@ -0,0 +1,78 @@
+// Measures integer scaling with the column-major loop sdl.scaled used before scale.cc and with
+// scaleInteger, and times the fractional scalers. From the repository root:
+//
+//   cl /O2 /EHsc tools\scale-bench.cc scale.cc
+//   g++ -O2 -o scale-bench tools/scale-bench.cc scale.cc
+//
+// scale-bench [width height]  scales a width x height image (default 960x540) and checks scaleInteger
+//                             still matches the old loop
+
+#include "../scale.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+static void oldScale(const unsigned int *pixels, int w, int h, unsigned int *data, int scaling) {
+	int neww = w * scaling;
+	for(int x = 0; x < w; x++) {
+		for(int y = 0; y < h; y++) {
+			unsigned int pixel = pixels[x + y * w];
+			for(int x1 = 0; x1 < scaling; x1++) {
+				for(int y1 = 0; y1 < scaling; y1++) {
+					data[(x * scaling + x1) + (y * scaling + y1) * neww] = pixel;
+				}
+			}
+		}
+	}
+}
+
+// microseconds per run, repeated for at least a tenth of a second to even out the clock's resolution
+template<typename Run> static double timeRuns(Run run) {
+	typedef std::chrono::steady_clock Clock;
+
+	int runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed;
+	do {
+		run();
+
+		runs++;
+		elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	} while(elapsed < 100000);
+
+	return elapsed / runs;
+}
+
+int main(int argc, char **argv) {
+	int w = argc > 2 ? atoi(argv[1]) : 960;
+	int h = argc > 2 ? atoi(argv[2]) : 540;
+	if(w < 1 || h < 1) {
+		fprintf(stderr, "usage: %s [width height]\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<unsigned int> source((size_t) w * h);
+	for(size_t i = 0; i < source.size(); i++)
+		source[i] = (unsigned int) (i * 2654435761u) | 0xff000000;
+
+	bool ok = true;
+	for(int scaling : { 2, 3 }) {
+		std::vector<unsigned int> before(source.size() * scaling * scaling), after(before.size());
+		double oldTime = timeRuns([&] { oldScale(source.data(), w, h, before.data(), scaling); });
+		double newTime = timeRuns([&] { scaleInteger(source.data(), w, h, after.data(), scaling); });
+
+		bool same = before == after;
+		ok = ok && same;
+		printf("%dx%d by %d: old loop %.0fus, scaleInteger %.0fus, %.1fx%s\n",
+			w, h, scaling, oldTime, newTime, oldTime / newTime, same ? "" : ", OUTPUT DIFFERS");
+	}
+
+	int neww = w * 3 / 2, newh = h * 3 / 2;
+	std::vector<unsigned int> scaled((size_t) neww * newh);
+	double nearestTime = timeRuns([&] { scaleNearest(source.data(), w, h, scaled.data(), neww, newh); });
+	double bilinearTime = timeRuns([&] { scaleBilinear(source.data(), w, h, scaled.data(), neww, newh); });
+	printf("%dx%d by 1.5: scaleNearest %.0fus, scaleBilinear %.0fus\n", w, h, nearestTime, bilinearTime);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+// Measures the BGRA to RGBA copy setBitmap does, with the per-byte loop it used before swizzle.cc and
+// with swizzleRows. swizzle.cc uses MSVC's intrin.h, so build it with MSVC from the repository root:
+//
+//   cl /O2 /EHsc tools\swizzle-bench.cc swizzle.cc
+//
+// swizzle-bench  prints both times for a screenshot-sized and a sprite-sized image, and checks they agree
+
+#include "../swizzle.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <chrono>
+
+static void oldSwizzle(unsigned char *pixelData, const unsigned char *pixels, int w, int h, int stride) {
+	for(int y = 0; y < h; y++) {
+		unsigned char *dst = pixelData + (y * w * 4);
+		const unsigned char *src = pixels + y * stride;
+
+		for(int x = 0; x < w; x++) {
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+			dst[3] = src[3];
+
+			dst += 4;
+			src += 4;
+		}
+	}
+}
+
+// microseconds per run, repeated for at least a tenth of a second to even out the clock's resolution
+template<typename Run> static double timeRuns(Run run) {
+	typedef std::chrono::steady_clock Clock;
+
+	int runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed;
+	do {
+		run();
+
+		runs++;
+		elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	} while(elapsed < 100000);
+
+	return elapsed / runs;
+}
+
+static bool measure(int w, int h) {
+	std::vector<unsigned char> source((size_t) w * h * 4);
+	for(size_t i = 0; i < source.size(); i++)
+		source[i] = (unsigned char) (i * 7 + i / 5);
+
+	std::vector<unsigned char> before(source.size()), after(source.size());
+	double oldTime = timeRuns([&] { oldSwizzle(before.data(), source.data(), w, h, w * 4); });
+	double newTime = timeRuns([&] { swizzleRows(after.data(), source.data(), w, h, w * 4); });
+
+	bool same = before == after;
+	printf("%dx%d: old loop %.1fus, swizzleRows %.1fus, %.1fx%s\n", w, h, oldTime, newTime, oldTime / newTime, same ? "" : ", OUTPUT DIFFERS");
+	return same;
+}
+
+int main() {
+	bool ok = measure(1920, 1080);
+	ok = measure(64, 64) && ok;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+-- Checks that surfaces made from parts of one image are told apart by caches keyed on a surface's
+-- pixels. Run it from a mod, or the game's console, once the library is loaded:
+--
+--   dofile("tools/test-surface-views.lua")
+--
+-- It writes a few small files into the current directory and removes them afterwards.
+
+local function u32(n)
+	return string.char(math.floor(n / 16777216) % 256, math.floor(n / 65536) % 256, math.floor(n / 256) % 256, n % 256)
+end
+
+-- QOI image of given width and height, pixels is a list of {r, g, b, a}
+local function qoi(w, h, pixels)
+	local parts = { "qoif", u32(w), u32(h), string.char(4, 0) }
+	for _, px in ipairs(pixels) do
+		parts[#parts + 1] = string.char(0xff, px[1], px[2], px[3], px[4])
+	end
+	parts[#parts + 1] = string.rep("\0", 7) .. "\1"
+	return table.concat(parts)
+end
+
+local function readFile(filename)
+	local file = assert(io.open(filename, "rb"))
+	local contents = file:read("*a")
+	file:close()
+	return contents
+end
+
+-- contents of the image surf is saved as
+local function saved(surf, filename)
+	assert(surf:save(filename), "couldn't save " .. filename)
+	while sdl.pendingSaves() > 0 do end
+
+	local contents = readFile(filename)
+	os.remove(filename)
+	return contents
+end
+
+local red, green = {255, 0, 0, 255}, {0, 255, 0, 255}
+local sheet = sdl.surfaceFromBlob(sdl.blobFromString(qoi(2, 1, { red, green })))
+assert(sheet:isValid(), "couldn't decode the sheet")
+
+local frame1 = sdl.subsurface(sheet, sdl.rect(0, 0, 1, 1))
+local frame2 = sdl.subsurface(sheet, sdl.rect(1, 0, 1, 1))
+
+-- frames have equal sizes, so only their pixels can tell the colormapped ones apart
+local map = { sdl.rgb(255, 0, 0), sdl.rgb(0, 0, 255) }
+local mapped1 = saved(sdl.colormapped(frame1, map), "test-surface-views-1.qoi")
+local mapped2 = saved(sdl.colormapped(frame2, map), "test-surface-views-2.qoi")
+
+assert(mapped1 ~= mapped2, "colormapping the second frame returned the first one")
+
+LOG("surface view tests passed")
@@ -0,0 +1,88 @@
+#include "vfs.h"
+#include "utils.h"
+
+Vfs::Vfs() {
+
+}
+
+void Vfs::mountDat(const std::string & filename, bool mapped) {
+	Mount mount;
+	mount.dat.reset(new ResourceDatFile(filename, mapped));
+	mounts.push_back(std::move(mount));
+
+	addToIndex((unsigned int) mounts.size() - 1);
+}
+
+void Vfs::mountDir(const std::string & path) {
+	Mount mount;
+	mount.directory = path;
+	while(!mount.directory.empty() && (mount.directory.back() == '/' || mount.directory.back() == '\\'))
+		mount.directory.pop_back();
+	mounts.push_back(std::move(mount));
+
+	addToIndex((unsigned int) mounts.size() - 1);
+}
+
+void Vfs::reload() {
+	index.clear();
+
+	for(unsigned int i = 0; i < mounts.size(); i++) {
+		if(mounts[i].dat)
+			mounts[i].dat->reload();
+
+		addToIndex(i);
+	}
+}
+
+void Vfs::addToIndex(unsigned int mount) {
+	Mount & m = mounts[mount];
+
+	Entry entry;
+	entry.mount = mount;
+
+	if(m.dat) {
+		const PathIndex<ResourceDatFile::FileInfo> & datIndex = m.dat->index;
+		index.reserve(index.size() + datIndex.size(), index.pool.size() + datIndex.pool.size());
+
+		for(const auto & file : datIndex.entries) {
+			entry.info = file.value;
+			index.insert(datIndex.pool.data() + file.nameOffset, file.nameLength, entry);
+		}
+		return;
+	}
+
+	size_t prefix = m.directory.size() + 1;
+	listDir(m.directory, [&](const std::string & fullpath, bool isDir) {
+		if(isDir || fullpath.size() <= prefix) return;
+
+		index.insert(fullpath.data() + prefix, fullpath.size() - prefix, entry);
+	});
+}
+
+bool Vfs::contains(const std::string & name) {
+	return index.find(name) != NULL;
+}
+
+bool Vfs::read(Blob *blob, const std::string & name) const {
+	const PathIndex<Entry>::Entry *found = index.findEntry(name.data(), name.size());
+	if(found == NULL) return false;
+
+	const Mount & mount = mounts[found->value.mount];
+	if(mount.dat) {
+		mount.dat->read(blob, found->value.info);
+	} else {
+		blob->readFile(mount.directory + "/" + index.name(*found));
+	}
+
+	return blob->data != NULL;
+}
+
+BlobFromVfs::BlobFromVfs(const Vfs *vfs, const std::string & filename) {
+	if(vfs == NULL) {
+		source = "vfs(<null>," + filename + ")";
+		return;
+	}
+	source = "vfs(" + filename + ")";
+
+	vfs->read(this, filename);
+}
@@ -0,0 +1,47 @@
+#ifndef __VFS_H__
+#define __VFS_H__
+
+#include "blob.h"
+#include "path-index.h"
+#include <string>
+#include <vector>
+#include <memory>
+
+// Merges .dat archives and loose directories into one lookup index. Mounts added later shadow
+// files with the same name from earlier mounts, so a lookup is a single hash probe however many mounts there are.
+struct Vfs {
+	struct Mount {
+		std::unique_ptr<ResourceDatFile> dat;
+		std::string directory;
+	};
+
+	struct Entry {
+		unsigned int mount;
+		ResourceDatFile::FileInfo info;
+	};
+
+	std::vector<Mount> mounts;
+	PathIndex<Entry> index;
+
+	Vfs();
+
+	void mountDat(const std::string & filename, bool mapped);
+	void mountDir(const std::string & path);
+
+	/// Reloads mounted archives, rescans mounted directories and rebuilds the merged index.
+	void reload();
+
+	bool contains(const std::string & name);
+
+	/// Fills blob with the contents of the named file from whichever mount provides it.
+	bool read(Blob *blob, const std::string & name) const;
+
+protected:
+	void addToIndex(unsigned int mount);
+};
+
+struct BlobFromVfs :public Blob {
+	BlobFromVfs(const Vfs *vfs, const std::string & filename);
+};
+
+#endif